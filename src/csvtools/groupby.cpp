@@ -0,0 +1,350 @@
+// SPDX-FileCopyrightText: 2023 Gottlieb+Freitag <info@gottliebtfreitag.de>
+// SPDX-License-Identifier: CC0-1.0
+#include <algorithm>
+#include <charconv>
+#include <clice/clice.h>
+#include <cmath>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <fmt/format.h>
+#include <fmt/std.h>
+#include <ivio/csv/reader.h>
+#include "table/writer.h"
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+namespace {
+void app();
+auto cliCmd = clice::Argument {
+    .args   = "groupby",
+    .desc   = "groups rows by key columns and aggregates the remaining columns",
+    .value  = std::vector<std::filesystem::path>{},
+    .cb     = &app,
+};
+auto cliHeader = clice::Argument {
+    .parent = &cliCmd,
+    .args   = {"-h", "--header"},
+    .desc   = "treats the first line as a header",
+};
+auto cliDelimiter = clice::Argument {
+    .parent = &cliCmd,
+    .args   = {"-d", "--delimiter"},
+    .desc   = "delimiter used in input file",
+    .value  = ',',
+};
+auto cliNoTrim = clice::Argument {
+    .parent = &cliCmd,
+    .args   = {"--no-trim"},
+    .desc   = "do not trim white spaces around entries",
+};
+auto cliKeys = clice::Argument {
+    .parent = &cliCmd,
+    .args   = {"-k", "--key"},
+    .desc   = "column to group by",
+    .value  = std::vector<std::string>{},
+};
+auto cliAggregates = clice::Argument {
+    .parent = &cliCmd,
+    .args   = {"-a", "--agg"},
+    .desc   = "aggregate of format <func>:<col>, available: count, sum, mean, min, max, median, p<percentile> (e.g. p95)",
+    .value  = std::vector<std::string>{},
+};
+auto cliJobs = clice::Argument {
+    .parent = &cliCmd,
+    .args   = {"-j", "--jobs"},
+    .desc   = "number of threads (0: number of cores)",
+    .value  = size_t{0},
+};
+
+struct Aggregate {
+    enum class Func { Count, Sum, Mean, Min, Max, Percentile };
+
+    Func func{Func::Count};
+    size_t col{0};
+    double percentile{0.};
+    std::string name;
+};
+
+auto parseAggregate(std::string const& s) -> Aggregate {
+    auto iter = s.find(":");
+    auto funcStr = s.substr(0, iter);
+    auto agg = Aggregate{.name = funcStr};
+    if (iter != std::string::npos) {
+        agg.col = std::stoul(s.substr(iter+1));
+    } else if (funcStr != "count") {
+        throw std::runtime_error{"aggregate must be of format: \"<func>:<col>\""};
+    }
+
+    using Func = Aggregate::Func;
+    if      (funcStr == "count")  agg.func = Func::Count;
+    else if (funcStr == "sum")    agg.func = Func::Sum;
+    else if (funcStr == "mean")   agg.func = Func::Mean;
+    else if (funcStr == "min")    agg.func = Func::Min;
+    else if (funcStr == "max")    agg.func = Func::Max;
+    else if (funcStr == "median") {
+        agg.func       = Func::Percentile;
+        agg.percentile = 50.;
+    } else if (funcStr.starts_with("p")) {
+        agg.func       = Func::Percentile;
+        agg.percentile = std::stod(funcStr.substr(1));
+        if (agg.percentile < 0. || agg.percentile > 100.) {
+            throw std::runtime_error{fmt::format("percentile {} must be between 0 and 100", agg.percentile)};
+        }
+    } else {
+        throw std::runtime_error{fmt::format("unknown aggregate {}, available: count, sum, mean, min, max, median, p<percentile>", funcStr)};
+    }
+    return agg;
+}
+
+// Running state of a single aggregate, partial states of different threads can be combined
+struct AggregateState {
+    size_t count{0};   // number of rows
+    size_t numbers{0}; // number of rows with a numeric value
+    double sum{0.};
+    double min{std::numeric_limits<double>::max()};
+    double max{std::numeric_limits<double>::lowest()};
+    std::vector<double> values; // only filled for percentiles
+
+    void add(Aggregate const& agg, std::vector<std::string> const& entries) {
+        count += 1;
+        if (agg.func == Aggregate::Func::Count || agg.col >= entries.size()) return;
+        auto const& s = entries[agg.col];
+        double v{};
+        auto [ptr, ec] = std::from_chars(s.data(), s.data() + s.size(), v);
+        if (ec != std::errc{} || ptr != s.data() + s.size()) return;
+        numbers += 1;
+        sum += v;
+        min = std::min(min, v);
+        max = std::max(max, v);
+        if (agg.func == Aggregate::Func::Percentile) {
+            values.push_back(v);
+        }
+    }
+
+    void merge(AggregateState&& other) {
+        count   += other.count;
+        numbers += other.numbers;
+        sum     += other.sum;
+        min     = std::min(min, other.min);
+        max     = std::max(max, other.max);
+        values.insert(values.end(), other.values.begin(), other.values.end());
+    }
+
+    auto result(Aggregate const& agg) -> std::string {
+        using Func = Aggregate::Func;
+        if (agg.func == Func::Count) return fmt::format("{}", count);
+        if (numbers == 0) return "";
+        switch (agg.func) {
+        case Func::Sum:  return fmt::format("{}", sum);
+        case Func::Mean: return fmt::format("{}", sum / numbers);
+        case Func::Min:  return fmt::format("{}", min);
+        case Func::Max:  return fmt::format("{}", max);
+        case Func::Percentile: {
+            // linear interpolation between closest ranks
+            auto pos   = agg.percentile / 100. * (values.size() - 1);
+            auto lower = static_cast<size_t>(std::floor(pos));
+            auto upper = std::min(lower + 1, values.size() - 1);
+            std::ranges::nth_element(values, values.begin() + lower);
+            auto lv = values[lower];
+            auto uv = lv;
+            if (upper != lower) {
+                uv = *std::ranges::min_element(values.begin() + upper, values.end());
+            }
+            return fmt::format("{}", lv + (uv - lv) * (pos - lower));
+        }
+        case Func::Count: break;
+        }
+        return "";
+    }
+};
+
+struct Group {
+    size_t firstRow; // used to report groups in order of their first appearance
+    std::vector<std::string> keys;
+    std::vector<AggregateState> states;
+};
+
+using GroupTable = std::unordered_map<std::string, Group>;
+
+struct Chunk {
+    size_t firstRow;
+    std::vector<std::vector<std::string>> rows;
+};
+
+void app() {
+    if (cliCmd->size() == 0) {
+        fmt::print("No files given\n");
+        return;
+    }
+
+    auto keys = std::vector<size_t>{};
+    for (auto const& k : *cliKeys) {
+        keys.push_back(std::stoul(k));
+    }
+    auto aggregates = std::vector<Aggregate>{};
+    for (auto const& a : *cliAggregates) {
+        aggregates.push_back(parseAggregate(a));
+    }
+    auto jobs = *cliJobs > 0 ? *cliJobs : std::max(size_t{1}, size_t{std::thread::hardware_concurrency()});
+
+    // rows are handed in chunks to the workers, each worker builds its own partial table
+    auto mutex    = std::mutex{};
+    auto cv       = std::condition_variable{};
+    auto queue    = std::deque<Chunk>{};
+    bool finished = false;
+    auto partials = std::vector<GroupTable>(jobs);
+
+    auto worker = [&](GroupTable& table) {
+        auto key = std::string{};
+        while (true) {
+            auto chunk = Chunk{};
+            {
+                auto lock = std::unique_lock{mutex};
+                cv.wait(lock, [&] { return finished || queue.size(); });
+                if (queue.empty()) return;
+                chunk = std::move(queue.front());
+                queue.pop_front();
+            }
+            cv.notify_all();
+
+            for (size_t i{0}; i < chunk.rows.size(); ++i) {
+                auto const& entries = chunk.rows[i];
+                key.clear();
+                for (auto col : keys) {
+                    if (col < entries.size()) key += entries[col];
+                    key += '\0';
+                }
+                auto [iter, inserted] = table.try_emplace(key);
+                auto& group = iter->second;
+                if (inserted) {
+                    group.firstRow = chunk.firstRow + i;
+                    for (auto col : keys) {
+                        group.keys.push_back(col < entries.size() ? entries[col] : std::string{});
+                    }
+                    group.states.resize(aggregates.size());
+                }
+                for (size_t j{0}; j < aggregates.size(); ++j) {
+                    group.states[j].add(aggregates[j], entries);
+                }
+            }
+        }
+    };
+
+    auto header = std::vector<std::string>{};
+    {
+        auto workers = std::vector<std::jthread>{};
+        for (auto& table : partials) {
+            workers.emplace_back(worker, std::ref(table));
+        }
+
+        constexpr size_t chunkSize = 1<<14;
+        size_t rowCount{0};
+        auto chunk = Chunk{};
+        auto submit = [&]() {
+            {
+                auto lock = std::unique_lock{mutex};
+                cv.wait(lock, [&] { return queue.size() < 2 * jobs; });
+                queue.push_back(std::move(chunk));
+            }
+            cv.notify_all();
+            chunk = Chunk{.firstRow = rowCount};
+        };
+
+        auto finish = [&]() {
+            {
+                auto lock = std::unique_lock{mutex};
+                finished = true;
+            }
+            cv.notify_all();
+        };
+        try {
+            for (auto const& p : *cliCmd) {
+                auto reader = ivio::csv::reader{{.input = p,
+                                                 .delimiter = *cliDelimiter,
+                                                 .trim      = !cliNoTrim,
+                }};
+                bool firstLine = true;
+                for (auto record : reader) {
+                    auto entries = std::vector<std::string>{};
+                    for (auto const& e : record.entries) {
+                        entries.emplace_back(e);
+                    }
+                    if (firstLine && cliHeader) {
+                        firstLine = false;
+                        if (header.empty()) header = std::move(entries);
+                        continue;
+                    }
+                    firstLine = false;
+                    chunk.rows.emplace_back(std::move(entries));
+                    rowCount += 1;
+                    if (chunk.rows.size() == chunkSize) {
+                        submit();
+                    }
+                }
+            }
+            if (chunk.rows.size()) {
+                submit();
+            }
+        } catch(...) {
+            finish();
+            throw;
+        }
+        finish();
+    }
+
+    // combine partial tables
+    auto& result = partials[0];
+    for (size_t i{1}; i < partials.size(); ++i) {
+        for (auto& [key, group] : partials[i]) {
+            auto [iter, inserted] = result.try_emplace(key, std::move(group));
+            if (inserted) continue;
+            auto& target = iter->second;
+            target.firstRow = std::min(target.firstRow, group.firstRow);
+            for (size_t j{0}; j < aggregates.size(); ++j) {
+                target.states[j].merge(std::move(group.states[j]));
+            }
+        }
+        partials[i].clear();
+    }
+    auto groups = std::vector<Group*>{};
+    for (auto& [key, group] : result) {
+        groups.push_back(&group);
+    }
+    std::ranges::sort(groups, {}, &Group::firstRow);
+
+    auto writer = ivio::table::writer {{
+        .output = std::cout,
+        .firstLineHeader = true,
+    }};
+    auto columnName = [&](size_t col) {
+        return col < header.size() ? header[col] : fmt::format("{}", col);
+    };
+    auto names = std::vector<std::string>{};
+    for (auto col : keys) {
+        names.push_back(columnName(col));
+    }
+    for (auto const& agg : aggregates) {
+        if (agg.func == Aggregate::Func::Count) {
+            names.push_back(agg.name);
+        } else {
+            names.push_back(fmt::format("{}({})", agg.name, columnName(agg.col)));
+        }
+    }
+    writer.write({
+        .entries = names,
+    });
+    auto entries = std::vector<std::string>{};
+    for (auto group : groups) {
+        entries = group->keys;
+        for (size_t j{0}; j < aggregates.size(); ++j) {
+            entries.push_back(group->states[j].result(aggregates[j]));
+        }
+        writer.write({
+            .entries = entries,
+        });
+    }
+}
+}
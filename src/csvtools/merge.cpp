@@ -1,18 +1,26 @@
 // SPDX-FileCopyrightText: 2023 Gottlieb+Freitag <info@gottliebtfreitag.de>
 // SPDX-License-Identifier: CC0-1.0
+#include <algorithm>
+#include <atomic>
 #include <clice/clice.h>
 #include <filesystem>
 #include <fmt/format.h>
 #include <fmt/std.h>
+#include <functional>
 #include <ivio/csv/reader.h>
-#include <ivio/csv/writer.h>
-#include "table/writer.h"
+#include "table/csv_writer.h"
 #include <iostream>
+#include <iterator>
+#include <mutex>
+#include <optional>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
 
 namespace {
 void app();
 auto cliCmd    = clice::Argument{ .args   = "merge",
-                                  .desc   = "merges same sized csv tables",
+                                  .desc   = "merges same sized csv tables, or tables sharing a key column (see --key)",
                                   .value  = std::vector<std::filesystem::path>{},
                                   .cb     = &app,
 };
@@ -22,48 +30,233 @@ auto cliMergeMode = clice::Argument{ .parent = &cliCmd,
                                      .value  = std::string{"min"}
 };
 
+auto cliKey = clice::Argument{ .parent = &cliCmd,
+                               .args   = "--key",
+                               .desc   = "match rows by the value of this column instead of by their position",
+                               .value  = size_t{0},
+};
+
+auto cliJobs = clice::Argument{ .parent = &cliCmd,
+                                .args   = {"-j", "--jobs"},
+                                .desc   = "number of threads (0: number of cores)",
+                                .value  = size_t{0},
+};
+
+using File = std::vector<ivio::csv::record>;
+using MergeFunc = std::function<void(std::string&, std::string const&)>;
+
+// calls cb(i) for each i in [0, n) distributed over 'jobs' threads, rethrows the first exception
+void parallelFor(size_t n, size_t jobs, std::function<void(size_t)> const& cb) {
+    auto next  = std::atomic_size_t{0};
+    auto error = std::exception_ptr{};
+    auto mutex = std::mutex{};
+    {
+        auto workers = std::vector<std::jthread>{};
+        for (size_t i{0}; i < std::min(jobs, n); ++i) {
+            workers.emplace_back([&]() {
+                try {
+                    for (auto idx = next++; idx < n; idx = next++) {
+                        cb(idx);
+                    }
+                } catch(...) {
+                    auto g = std::lock_guard{mutex};
+                    if (!error) error = std::current_exception();
+                }
+            });
+        }
+    }
+    if (error) std::rethrow_exception(error);
+}
+
+// merges all entries of 'test' into 'base', entries missing in 'base' are taken over
+void mergeRecord(ivio::csv::record& base, ivio::csv::record const& test, MergeFunc const& mergeFunc) {
+    for (size_t col{base.entries.size()}; col < test.entries.size(); ++col) {
+        base.entries.push_back(test.entries[col]);
+    }
+    for (size_t col{0}; col < test.entries.size(); ++col) {
+        mergeFunc(base.entries[col], test.entries[col]);
+    }
+}
+
+// merge by position, no file may be larger than the first one
+auto mergeByPosition(std::vector<File>& files, MergeFunc const& mergeFunc) -> File {
+    auto const& paths = *cliCmd;
+    for (size_t i{1}; i < files.size(); ++i) {
+        auto const& file = files[i];
+        bool fits = file.size() <= files[0].size();
+        for (size_t row{0}; fits && row < file.size(); ++row) {
+            fits = file[row].entries.size() <= files[0][row].entries.size();
+        }
+        if (!fits) {
+            throw std::runtime_error{fmt::format("{} and {} differ in shape, use --key to match rows by a key column", paths[0], paths[i])};
+        }
+    }
+
+    // merge down to smallest value
+    for (auto const& file : files) {
+        for (size_t row{0}; row < file.size(); ++row) {
+            for (size_t col{0}; col < file[row].entries.size(); ++col) {
+                auto const& entry = file[row].entries[col];
+                auto& baseEntry = files[0][row].entries[col];
+                mergeFunc(baseEntry, entry);
+            }
+        }
+    }
+    return std::move(files[0]);
+}
+
+// A merged row and the position of its first occurrence
+struct MergedRecord {
+    size_t fileIdx, row;
+    ivio::csv::record record;
+};
+
+// Both key based merges report rows in order of their first occurrence (file by file, row by row)
+auto inFirstOccurrenceOrder(std::vector<MergedRecord> entries) -> File {
+    std::ranges::sort(entries, [](MergedRecord const& lhs, MergedRecord const& rhs) {
+        return std::tie(lhs.fileIdx, lhs.row) < std::tie(rhs.fileIdx, rhs.row);
+    });
+    auto result = File{};
+    result.reserve(entries.size());
+    for (auto& e : entries) {
+        result.emplace_back(std::move(e.record));
+    }
+    return result;
+}
+
+// merge by key, if all files are strictly sorted by the key column
+auto mergeBySortedKey(std::vector<File> const& files, size_t key, MergeFunc const& mergeFunc) -> File {
+    auto entries = std::vector<MergedRecord>{};
+    auto pos     = std::vector<size_t>(files.size(), 0);
+    while (true) {
+        // find smallest key of all current rows
+        std::string const* minKey{};
+        for (size_t i{0}; i < files.size(); ++i) {
+            if (pos[i] == files[i].size()) continue;
+            auto const& k = files[i][pos[i]].entries[key];
+            if (!minKey || k < *minKey) minKey = &k;
+        }
+        if (!minKey) break;
+
+        auto current = std::string{*minKey};
+        std::optional<MergedRecord> entry;
+        for (size_t i{0}; i < files.size(); ++i) {
+            if (pos[i] == files[i].size()) continue;
+            auto const& row = files[i][pos[i]];
+            if (row.entries[key] != current) continue;
+            if (!entry) entry = MergedRecord{i, pos[i], row};
+            else mergeRecord(entry->record, row, mergeFunc);
+            pos[i] += 1;
+        }
+        entries.emplace_back(std::move(*entry));
+    }
+    return inFirstOccurrenceOrder(std::move(entries));
+}
+
+// merge by key using a partitioned hash join
+auto mergeByHashedKey(std::vector<File> const& files, size_t key, size_t jobs, MergeFunc const& mergeFunc) -> File {
+    auto const partitions = jobs;
+
+    // assign each row to a partition
+    auto partitionRows = std::vector<std::vector<std::vector<size_t>>>(files.size()); // file → partition → row
+    parallelFor(files.size(), jobs, [&](size_t fileIdx) {
+        auto& rows = partitionRows[fileIdx];
+        rows.resize(partitions);
+        for (size_t row{0}; row < files[fileIdx].size(); ++row) {
+            auto hash = std::hash<std::string>{}(files[fileIdx][row].entries[key]);
+            rows[hash % partitions].push_back(row);
+        }
+    });
+
+    // join each partition independently
+    auto results = std::vector<std::vector<MergedRecord>>(partitions);
+    parallelFor(partitions, jobs, [&](size_t partition) {
+        auto& result = results[partition];
+        auto index   = std::unordered_map<std::string_view, size_t>{};
+        for (size_t fileIdx{0}; fileIdx < files.size(); ++fileIdx) {
+            for (auto row : partitionRows[fileIdx][partition]) {
+                auto const& record = files[fileIdx][row];
+                auto k = std::string_view{record.entries[key]};
+                if (auto iter = index.find(k); iter != index.end()) {
+                    mergeRecord(result[iter->second].record, record, mergeFunc);
+                } else {
+                    index.try_emplace(k, result.size());
+                    result.push_back({fileIdx, row, record});
+                }
+            }
+        }
+    });
+
+    auto entries = std::vector<MergedRecord>{};
+    for (auto& result : results) {
+        std::ranges::move(result, std::back_inserter(entries));
+    }
+    return inFirstOccurrenceOrder(std::move(entries));
+}
+
 void app() {
     if (cliCmd->size() == 0) {
         fmt::print("No files given\n");
         return;
     }
-    using File = std::vector<ivio::csv::record>;
-    auto files = std::vector<File>{};
+    auto const& paths = *cliCmd;
+    auto jobs = *cliJobs > 0 ? *cliJobs : std::max(size_t{1}, size_t{std::thread::hardware_concurrency()});
 
     // load all files
-    for (auto p : *cliCmd) {
-        auto reader = ivio::csv::reader{{.input = p,
+    auto files = std::vector<File>(paths.size());
+    parallelFor(paths.size(), jobs, [&](size_t i) {
+        auto reader = ivio::csv::reader{{.input = paths[i],
                                          .delimiter = ','
         }};
-        files.emplace_back();
         for (auto record : reader) {
-            files.back().push_back(record);
+            files[i].push_back(record);
         }
-    }
+    });
 
     //
-    auto mergeFunc = std::function<void(std::string&, std::string const&)>{};
-    mergeFunc = [](std::string& current, std::string const& test) {
-        current = std::min(current, test);
-    };
+    auto mergeFunc = MergeFunc{};
+    if (*cliMergeMode == "min") {
+        mergeFunc = [](std::string& current, std::string const& test) {
+            current = std::min(current, test);
+        };
+    } else if (*cliMergeMode == "max") {
+        mergeFunc = [](std::string& current, std::string const& test) {
+            current = std::max(current, test);
+        };
+    } else {
+        throw std::runtime_error{fmt::format("unknown merge mode {}, available: min, max", *cliMergeMode)};
+    }
 
-    // merge down to smallest value
-    for (auto const& file : files) {
-        for (size_t row{0}; row < file.size(); ++row) {
-            for (size_t col{0}; col < file[row].entries.size(); ++col) {
-                auto const& entry = file[row].entries[col];
-                auto& baseEntry = files[0][row].entries[col];
-                mergeFunc(baseEntry, entry);
+    auto result = File{};
+    if (!cliKey) {
+        result = mergeByPosition(files, mergeFunc);
+    } else {
+        auto key = *cliKey;
+        for (size_t i{0}; i < files.size(); ++i) {
+            for (size_t row{0}; row < files[i].size(); ++row) {
+                if (files[i][row].entries.size() <= key) {
+                    throw std::runtime_error{fmt::format("{} row {} has no key column {}", paths[i], row, key)};
+                }
             }
         }
-    }
 
+        auto isStrictlySorted = std::ranges::all_of(files, [&](File const& file) {
+            return std::ranges::adjacent_find(file, [&](auto const& lhs, auto const& rhs) {
+                return lhs.entries[key] >= rhs.entries[key];
+            }) == file.end();
+        });
+        if (isStrictlySorted) {
+            result = mergeBySortedKey(files, key, mergeFunc);
+        } else {
+            result = mergeByHashedKey(files, key, jobs, mergeFunc);
+        }
+    }
 
     {
-        auto writer = ivio::csv::writer{{.output = std::cout,
+        auto writer = ivio::table::csv_writer{{.output = std::cout,
         }};
 
-        for (auto record : files[0]) {
+        for (auto const& record : result) {
             writer.write({
                 .entries = record.entries,
             });
@@ -0,0 +1,448 @@
+// SPDX-FileCopyrightText: 2023 Gottlieb+Freitag <info@gottliebtfreitag.de>
+// SPDX-License-Identifier: CC0-1.0
+#include "pipeline.h"
+#include "table_cache.h"
+
+#include <charconv>
+#include <cmath>
+#include <fmt/format.h>
+#include <iterator>
+#include <stdexcept>
+
+namespace csvtools {
+
+namespace detail {
+
+        // parse number
+auto parseNumberRange(std::string s, size_t min, size_t max) -> std::tuple<size_t, size_t> {
+    if (auto iter = s.find("-"); iter != std::string::npos) {
+        auto start = s.substr(0, iter);
+        size_t startI = min;
+        auto end   = s.substr(iter+1);
+        size_t endI = max;
+
+        if (start.size()) {
+            startI = std::stoi(start);
+        }
+        if (end.size()) {
+            endI = std::stoi(end);
+        }
+        return {startI, endI};
+    } else if (s.size()) {
+        auto v = std::stoi(s);
+        return {v, v};
+    }
+    return {0, max};
+};
+
+auto parseNextF(std::string& s) -> std::string {
+    auto iter = s.find(":");
+    if (iter == std::string::npos) {
+        throw std::runtime_error{"filter must be of format: \"<rnr>:<cnr>:<filter>:<fmt>\""};
+    }
+    auto ret = s.substr(0, iter);
+    s = s.substr(iter+1);
+    return ret;
+}
+
+}
+
+namespace {
+using namespace detail;
+
+// like std::stod, but without copying into a std::string
+auto parseDouble(std::string_view s) -> double {
+    while (s.size() && (s.front() == ' ' || s.front() == '\t')) s = s.substr(1);
+    if (s.starts_with('+')) s = s.substr(1);
+    double v{};
+    auto [ptr, ec] = std::from_chars(s.data(), s.data() + s.size(), v);
+    if (ec == std::errc::invalid_argument) throw std::invalid_argument{"parseDouble"};
+    if (ec == std::errc::result_out_of_range) throw std::out_of_range{"parseDouble"};
+    return v;
+}
+}
+
+auto loadMapping(std::filesystem::path const& path) -> Mapping {
+    auto mapping = Mapping{};
+    auto table = loadTable(path, ',', false);
+    for (auto const& entries : *table) {
+        if (entries.size() == 2) {
+            mapping[std::string{entries[0]}] = entries[1];
+        }
+    }
+    return mapping;
+}
+
+Pipeline::Pipeline(PipelineConfig config)
+    : transpose{config.transpose}
+    , mapping{std::move(config.mapping)}
+    , order{std::move(config.order)}
+{
+    for (auto l : config.transforms) {
+        auto rowsStr      = parseNextF(l);
+        auto colsStr      = parseNextF(l);
+        auto transformStr = l;
+
+        auto [rstart, rend] = parseNumberRange(rowsStr, 0, std::numeric_limits<size_t>::max());
+        auto spec = TransformSpec {
+            .rstart  = rstart,
+            .rend    = rend,
+            .colsStr = colsStr,
+        };
+        if (transformStr.starts_with("scale ")) {
+            spec.kind = TransformSpec::Kind::Scale;
+            spec.per  = std::stod(transformStr.substr(6));
+        } else if (transformStr == "inv") {
+            spec.kind = TransformSpec::Kind::Inv;
+        } else if (transformStr == "log10") {
+            spec.kind = TransformSpec::Kind::Log10;
+        }
+        transforms.emplace_back(std::move(spec));
+    }
+
+    for (auto l : config.filters) {
+        auto rowsStr   = parseNextF(l);
+        auto colsStr   = parseNextF(l);
+        auto filterStr = parseNextF(l);
+        auto suffix    = l;
+
+        auto [rstart, rend] = parseNumberRange(rowsStr, 0, std::numeric_limits<size_t>::max());
+        auto spec = FilterSpec {
+            .rstart  = rstart,
+            .rend    = rend,
+            .colsStr = colsStr,
+            .suffix  = suffix,
+        };
+        using Kind = FilterSpec::Kind;
+        auto withPer = [&](Kind kind) {
+            spec.kind = kind;
+            spec.per  = std::stod(filterStr.substr(5));
+        };
+        if      (filterStr == "true")  spec.kind = Kind::True;
+        else if (filterStr == "float") spec.kind = Kind::Float;
+        else if (filterStr == "cmin")  spec.kind = Kind::CMin;
+        else if (filterStr == "cmax")  spec.kind = Kind::CMax;
+        else if (filterStr == "rmin")  spec.kind = Kind::RMin;
+        else if (filterStr == "rmax")  spec.kind = Kind::RMax;
+        else if (filterStr.starts_with("cmin ")) withPer(Kind::CMinPer);
+        else if (filterStr.starts_with("cmax ")) withPer(Kind::CMaxPer);
+        else if (filterStr.starts_with("rmin ")) withPer(Kind::RMinPer);
+        else if (filterStr.starts_with("rmax ")) withPer(Kind::RMaxPer);
+        filters.emplace_back(std::move(spec));
+    }
+
+    for (auto const& l : config.customFormats) {
+        auto iter = l.find(":");
+        if (iter == std::string::npos) {
+            throw std::runtime_error{"custom format must be of format: \"<nr>:<fmt>\""};
+        }
+        auto prefix = l.substr(0, iter);
+        auto suffix = l.substr(iter+1);
+        if (prefix.size()) {
+            customFmt.emplace_back(std::stoi(prefix), suffix);
+        } else {
+            customFmt.emplace_back(std::nullopt, suffix);
+        }
+    }
+}
+
+FileView::FileView(Pipeline const& pipeline_, std::shared_ptr<Table const> table)
+    : pipeline{pipeline_}
+    , source{std::move(table)}
+    , values{source->get_allocator()}
+    , rendered{source->get_allocator()}
+{
+    auto alloc = source->get_allocator();
+    for (auto const& entries : *source) {
+        inputWidth = std::max(inputWidth, entries.size());
+    }
+    bool quadratic = std::ranges::all_of(*source, [&](Row const& entries) {
+        return entries.size() == inputWidth;
+    });
+
+    auto transposed = Table{alloc};
+    if (pipeline.transpose) {
+        transposed.resize(inputWidth, Row(source->size(), alloc));
+        for (size_t y{0}; y < source->size(); ++y) {
+            auto const& entries = (*source)[y];
+            for (size_t x{0}; x < entries.size(); ++x) {
+                transposed[x][y] = entries[x];
+            }
+        }
+        inputWidth = source->size();
+    }
+    width = inputWidth;
+
+    if (pipeline.order.size() > 0) {
+        size_t orderedWidth{0};
+        for (auto e : pipeline.order) {
+            if (e == "row") {
+                orderRanges.emplace_back(e, 0, 1);
+                orderedWidth += 1;
+                continue;
+            }
+            if (e.starts_with("row ")) {
+                auto start = std::stoi(e.substr(4));
+                orderRanges.emplace_back("row", start, 1);
+                orderedWidth += 1;
+                continue;
+            }
+            if (e.starts_with("const ")) {
+                auto v = std::stoi(e.substr(5));
+                orderRanges.emplace_back("row", v, 0);
+                orderedWidth += 1;
+                continue;
+            }
+            auto [start, end] = parseNumberRange(e, 0, width-1);
+            if (start >= width || end >= width) {
+                throw std::runtime_error{fmt::format("invalid order range {}-{} max value allowed is {}", start, end, width-1)};
+            }
+            orderRanges.emplace_back("range", start, end);
+            orderedWidth += end >= start ? end - start + 1 : 0;
+        }
+        width = orderedWidth;
+    }
+
+    auto colRect = [&](auto const& spec) {
+        auto [cstart, cend] = parseNumberRange(spec.colsStr, 0, width-1);
+        return Rect {
+            spec.rstart, spec.rend,
+            cstart, cend,
+        };
+    };
+    for (auto const& spec : pipeline.transforms) {
+        transformMap.emplace_back(colRect(spec), &spec);
+    }
+    for (auto const& spec : pipeline.filters) {
+        filterMap.emplace_back(colRect(spec), &spec);
+    }
+    for (auto const& [col, suffix] : pipeline.customFmt) {
+        if (col) {
+            customFmt[*col] = suffix;
+        } else {
+            for (size_t i{0}; i < width; ++i) {
+                customFmt[i] = suffix;
+            }
+        }
+    }
+
+    // rows are only copied if the pipeline changes them, short rows are filled up
+    prepared = pipeline.transpose || !quadratic || pipeline.mapping.size() || orderRanges.size() || transformMap.size();
+    if (pipeline.transpose) {
+        values.reserve(transposed.size());
+        for (auto& entries : transposed) {
+            values.emplace_back(prepareRow(values.size(), std::move(entries)));
+        }
+    } else if (prepared) {
+        values.reserve(source->size());
+        for (auto const& entries : *source) {
+            values.emplace_back(prepareRow(values.size(), Row{entries, alloc}));
+        }
+    }
+
+    rendering = filterMap.size() || customFmt.size();
+    if (rendering) {
+        rendered.reserve(size());
+        for (size_t row{0}; row < size(); ++row) {
+            rendered.emplace_back(renderRow(row));
+        }
+    }
+}
+
+auto FileView::append(Table table) -> std::vector<size_t> {
+    if (pipeline.transpose) {
+        throw std::runtime_error{"rows can not be appended to a transposed view"};
+    }
+    if (!prepared) {
+        // appended rows are owned by the view, from now on all rows are stored in values
+        values.reserve(source->size() + table.size());
+        for (auto const& entries : *source) {
+            values.emplace_back(prepareRow(values.size(), Row{entries, values.get_allocator()}));
+        }
+        prepared = true;
+    }
+
+    auto const first = values.size();
+    for (auto& entries : table) {
+        values.emplace_back(prepareRow(values.size(), std::move(entries)));
+    }
+
+    // Update cached column aggregates. Appended values can only move the extreme further out,
+    // the filters (for positive factors) then apply to fewer old rows, but never to new ones.
+    // So only the rows in which a filter of a changed aggregate applied are rendered again.
+    auto dirty = std::vector<size_t>{};
+    // aggregates are ordered by kind, column aggregates come first. Row aggregates (one per row)
+    // are not visited, they can not change as old rows are not modified
+    for (auto& [key, aggregate] : aggregates) {
+        if (!key.isColumn()) {
+            break;
+        }
+        if (!aggregate.valid || key.end < first || values.empty()) {
+            continue;
+        }
+        auto v = aggregate.value;
+        try {
+            for (auto row{std::max(key.start, first)}; row <= std::min(key.end, values.size()-1); ++row) {
+                v = key.fold(parseDouble(values[row][key.idx]), v);
+            }
+        } catch(...) {
+            // the aggregate is not valid anymore, none of its filters applies
+            aggregate.valid = false;
+        }
+        if (!aggregate.valid || v != aggregate.value) {
+            aggregate.value = v;
+            std::ranges::move(aggregate.appliedRows, std::back_inserter(dirty));
+            aggregate.appliedRows.clear();
+        }
+    }
+    std::ranges::sort(dirty);
+    auto [last, end] = std::ranges::unique(dirty);
+    dirty.erase(last, end);
+
+    auto changed = std::vector<size_t>{};
+    for (auto row : dirty) {
+        auto entries = renderRow(row);
+        if (entries != rendered[row]) {
+            rendered[row] = std::move(entries);
+            changed.push_back(row);
+        }
+    }
+    for (auto row{first}; row < values.size(); ++row) {
+        if (rendering) {
+            rendered.emplace_back(renderRow(row));
+        }
+        changed.push_back(row);
+    }
+    return changed;
+}
+
+// applies mapping, column order and transforms
+auto FileView::prepareRow(size_t row, Row entries) const -> Row {
+    entries.resize(inputWidth);
+
+    if (pipeline.mapping.size()) {
+        for (auto& v : entries) {
+            if (auto iter = pipeline.mapping.find(std::string_view{v}); iter != pipeline.mapping.end()) {
+                v = iter->second;
+            }
+        }
+    }
+
+    if (orderRanges.size()) {
+        auto out_entries = Row{values.get_allocator()};
+        for (auto [type, start, end] : orderRanges) {
+            if (type == "row") {
+                out_entries.emplace_back(std::to_string(row*end + start));
+            } else if (type == "range") {
+                for (; start <= end; ++start) {
+                    out_entries.emplace_back(entries[start]);
+                }
+            }
+        }
+        entries = std::move(out_entries);
+    }
+
+    auto transform = [](TransformSpec const& spec, std::string_view s) -> std::string {
+        using Kind = TransformSpec::Kind;
+        switch (spec.kind) {
+        case Kind::Scale: return fmt::format("{}", parseDouble(s)*spec.per);
+        case Kind::Inv:   return fmt::format("{}", 1./parseDouble(s));
+        case Kind::Log10: return fmt::format("{}", std::log10(parseDouble(s)));
+        case Kind::None:  break;
+        }
+        return std::string{s};
+    };
+    for (size_t col{0}; col < entries.size(); ++col) {
+        auto& e = entries[col];
+        for (auto const& [rect, spec] : transformMap) {
+            if (!rect.isInRange(row, col)) continue;
+            try {
+                e = transform(*spec, e);
+            } catch(...){}
+        }
+    }
+    return entries;
+}
+
+// applies filters and custom formats
+auto FileView::renderRow(size_t row) -> Row {
+    auto entries = Row{value(row), rendered.get_allocator()};
+    for (size_t col{0}; col < entries.size(); ++col) {
+        auto& e = entries[col];
+        for (auto const& [rect, spec] : filterMap) {
+            if (!rect.isInRange(row, col)) continue;
+            try {
+                e = filter(rect, *spec, row, col, e);
+            } catch(...){}
+        }
+        if (auto iter = customFmt.find(col); iter != customFmt.end()) {
+            e = fmt::format(fmt::runtime(iter->second), std::string_view{e});
+        }
+    }
+    return entries;
+}
+
+auto FileView::aggregate(AggregateKey key) -> double {
+    auto [iter, inserted] = aggregates.try_emplace(key);
+    auto& aggregate = iter->second;
+    if (inserted) {
+        auto v = key.init();
+        try {
+            if (key.isColumn()) {
+                for (size_t i{key.start}; i <= key.end && i < size(); ++i) {
+                    v = key.fold(parseDouble(value(i)[key.idx]), v);
+                }
+            } else {
+                for (size_t i{key.start}; i < std::min(value(key.idx).size(), key.end); ++i) {
+                    v = key.fold(parseDouble(value(key.idx)[i]), v);
+                }
+            }
+        } catch(...) {
+            aggregate.valid = false;
+        }
+        aggregate.value = v;
+    }
+    if (!aggregate.valid) {
+        throw std::invalid_argument{"aggregate over entries that are not numbers"};
+    }
+    return aggregate.value;
+}
+
+auto FileView::filter(Rect const& rect, FilterSpec const& spec, size_t row, size_t col, std::string_view s) -> std::string {
+    using Kind = FilterSpec::Kind;
+    using AKind = AggregateKey::Kind;
+    auto result = std::string{s};
+    auto colKey = std::optional<AggregateKey>{};
+    auto apply = [&](bool cond) {
+        if (cond) {
+            result = fmt::format(fmt::runtime(spec.suffix), s);
+            // remember the row, it must be rendered again if the aggregate changes
+            if (colKey) {
+                aggregates[*colKey].appliedRows.push_back(row);
+            }
+        }
+    };
+    auto colAggregate = [&](AKind kind) {
+        colKey = AggregateKey{kind, col, rect.startRow, rect.endRow};
+        return aggregate(*colKey);
+    };
+    auto rowAggregate = [&](AKind kind) {
+        return aggregate({kind, row, rect.startCol, rect.endCol});
+    };
+    switch (spec.kind) {
+    case Kind::True:    apply(true); break;
+    case Kind::CMin:    apply(parseDouble(s) == colAggregate(AKind::CMin)); break;
+    case Kind::CMax:    apply(parseDouble(s) == colAggregate(AKind::CMax)); break;
+    case Kind::CMinPer: apply(parseDouble(s)*spec.per <= colAggregate(AKind::CMin)); break;
+    case Kind::CMaxPer: apply(parseDouble(s) >= colAggregate(AKind::CMax)*spec.per); break;
+    case Kind::RMin:    apply(parseDouble(s) == rowAggregate(AKind::RMin)); break;
+    case Kind::RMax:    apply(parseDouble(s) == rowAggregate(AKind::RMax)); break;
+    case Kind::RMinPer: apply(parseDouble(s)*spec.per <= rowAggregate(AKind::RMin)); break;
+    case Kind::RMaxPer: apply(parseDouble(s) >= rowAggregate(AKind::RMax)*spec.per); break;
+    case Kind::Float:   result = fmt::format(fmt::runtime(spec.suffix), parseDouble(s)); break;
+    case Kind::None:    break;
+    }
+    return result;
+}
+
+}
@@ -0,0 +1,173 @@
+// SPDX-FileCopyrightText: 2023 Gottlieb+Freitag <info@gottliebtfreitag.de>
+// SPDX-License-Identifier: CC0-1.0
+#pragma once
+
+#include "table.h"
+
+#include <algorithm>
+#include <compare>
+#include <filesystem>
+#include <functional>
+#include <limits>
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+namespace csvtools {
+
+namespace detail {
+struct Rect {
+    size_t startRow{0}, endRow{std::numeric_limits<size_t>::max()};
+    size_t startCol{0}, endCol{std::numeric_limits<size_t>::max()};
+
+    bool isInRange(size_t row, size_t col) const {
+        bool valid = true;
+        valid = valid && startRow <= row && row <= endRow;
+        valid = valid && startCol <= col && col <= endCol;
+        return valid;
+    }
+};
+
+// parses "<start>-<end>", "<start>-", "-<end>" or "<nr>"
+auto parseNumberRange(std::string s, size_t min, size_t max) -> std::tuple<size_t, size_t>;
+
+// removes and returns everything up to the next ':'
+auto parseNextF(std::string& s) -> std::string;
+
+// a transform entry, parsed once and shared by all files
+struct TransformSpec {
+    enum class Kind { None, Scale, Inv, Log10 };
+
+    size_t      rstart, rend;
+    std::string colsStr; // column range depends on the width of each file
+    Kind        kind{Kind::None};
+    double      per{1.};
+};
+
+// a filter entry, parsed once and shared by all files
+struct FilterSpec {
+    enum class Kind { None, True, Float, CMin, CMax, CMinPer, CMaxPer, RMin, RMax, RMinPer, RMaxPer };
+
+    size_t      rstart, rend;
+    std::string colsStr; // column range depends on the width of each file
+    Kind        kind{Kind::None};
+    double      per{1.};
+    std::string suffix;
+};
+
+struct StringHash {
+    using is_transparent = void;
+    auto operator()(std::string_view s) const -> size_t {
+        return std::hash<std::string_view>{}(s);
+    }
+};
+}
+
+using Mapping = std::unordered_map<std::string, std::string, detail::StringHash, std::equal_to<>>;
+
+// Loads a csv file with lines of format: <value>,<replacement>
+auto loadMapping(std::filesystem::path const& path) -> Mapping;
+
+// Options of the processing pipeline, they match the options of `csvtools print`
+struct PipelineConfig {
+    bool transpose{false};                  // swap rows and columns
+    Mapping mapping;                        // entries that are replaced
+    std::vector<std::string> order;         // order of the columns: "row", "row <start>", "const <v>" or "<start>-<end>"
+    std::vector<std::string> transforms;    // "<rows>:<cols>:<transform>"
+    std::vector<std::string> filters;       // "<rows>:<cols>:<filter>:<fmt>"
+    std::vector<std::string> customFormats; // "<col>:<fmt>"
+};
+
+// A parsed PipelineConfig, can be shared by any number of FileViews (also from different threads)
+class Pipeline {
+public:
+    explicit Pipeline(PipelineConfig config);
+
+private:
+    friend class FileView;
+
+    bool transpose;
+    Mapping mapping;
+    std::vector<std::string> order;
+    std::vector<detail::TransformSpec> transforms;
+    std::vector<detail::FilterSpec> filters;
+    std::vector<std::tuple<std::optional<size_t>, std::string>> customFmt; // no column means all columns
+};
+
+// The processing state of a single table: the values after mapping, order and transforms,
+// the aggregates used by the filters and the rendered values after filters and custom formats.
+// The given table is not copied, it may be shared (e.g. with the table cache). Prepared and
+// rendered values are only stored if the pipeline changes them.
+// All memory is allocated from the memory resource of the given table.
+// Rows can be appended, cached aggregates are updated incrementally.
+class FileView {
+public:
+    FileView(Pipeline const& pipeline, std::shared_ptr<Table const> table);
+
+    auto size() const -> size_t {
+        return prepared ? values.size() : source->size();
+    }
+
+    // rendered row
+    auto row(size_t i) const -> Row const& {
+        return rendering ? rendered[i] : value(i);
+    }
+
+    // appends rows, returns the indices of all rendered rows that changed or are new.
+    // Throws if the pipeline transposes the table, appended rows would be new columns.
+    auto append(Table table) -> std::vector<size_t>;
+
+private:
+    struct AggregateKey {
+        enum class Kind { CMin, CMax, RMin, RMax }; // column aggregates first, see append()
+
+        Kind kind;
+        size_t idx, start, end; // column or row, followed by the range of rows or columns
+        auto operator<=>(AggregateKey const&) const = default;
+
+        bool isColumn() const {
+            return kind == Kind::CMin || kind == Kind::CMax;
+        }
+        auto fold(double lhs, double rhs) const -> double {
+            return (kind == Kind::CMin || kind == Kind::RMin) ? std::min(lhs, rhs) : std::max(lhs, rhs);
+        }
+        auto init() const -> double {
+            return (kind == Kind::CMin || kind == Kind::RMin) ? std::numeric_limits<double>::max() : std::numeric_limits<double>::lowest();
+        }
+    };
+
+    struct Aggregate {
+        double value;
+        bool valid{true};                // false if an entry in the range is not a number
+        std::vector<size_t> appliedRows; // rows in which a filter depending on this aggregate applies
+    };
+
+    Pipeline const& pipeline;
+    std::shared_ptr<Table const> source;
+    size_t inputWidth{}; // width of the loaded rows
+    size_t width{};      // width after reordering the columns
+    bool prepared{};     // values are stored, otherwise the rows of source are used unchanged
+    bool rendering{};    // rendered values are stored, otherwise the values are used unchanged
+    Table values;
+    Table rendered;
+    std::vector<std::tuple<std::string, size_t, size_t>> orderRanges;
+    std::vector<std::tuple<detail::Rect, detail::TransformSpec const*>> transformMap;
+    std::vector<std::tuple<detail::Rect, detail::FilterSpec const*>> filterMap;
+    std::unordered_map<size_t, std::string> customFmt;
+    std::map<AggregateKey, Aggregate> aggregates;
+
+    auto value(size_t row) const -> Row const& {
+        return prepared ? values[row] : (*source)[row];
+    }
+    auto prepareRow(size_t row, Row entries) const -> Row;
+    auto renderRow(size_t row) -> Row;
+    auto aggregate(AggregateKey key) -> double;
+    auto filter(detail::Rect const& rect, detail::FilterSpec const& spec, size_t row, size_t col, std::string_view s) -> std::string;
+};
+
+}
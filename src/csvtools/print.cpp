@@ -1,12 +1,22 @@
 // SPDX-FileCopyrightText: 2023 Gottlieb+Freitag <info@gottliebtfreitag.de>
 // SPDX-License-Identifier: CC0-1.0
+#include <atomic>
 #include <clice/clice.h>
 #include <filesystem>
 #include <fmt/format.h>
 #include <fmt/std.h>
-#include <ivio/csv/reader.h>
-#include "table/writer.h"
+#include <fstream>
+#include <future>
+#include "print.h"
+#include "serve.h"
+#include "table/emitter.h"
 #include <iostream>
+#include <optional>
+#include <sstream>
+#include <sys/ioctl.h>
+#include "table_cache.h"
+#include <thread>
+#include <unistd.h>
 
 namespace {
 void app();
@@ -43,16 +53,18 @@ auto cliUseMapping = clice::Argument {
     .desc   = "A CSV file, which defines mapping",
     .value  = std::filesystem::path{},
 };
-enum class OutputType { Table, CSV, Latex };
+using csvtools::OutputType;
 auto cliOutputType = clice::Argument {
     .parent = &cliCmd,
     .args   = {"--ot", "--output_type"},
-    .desc   = "type of the output file. Available: table, csv, latex",
+    .desc   = "type of the output file. Available: table, csv, tsv, latex, markdown",
     .value  = OutputType::Table,
     .mapping = {{
-        {"table", OutputType::Table},
-        {"csv",   OutputType::CSV},
-        {"latex", OutputType::Latex},
+        {"table",    OutputType::Table},
+        {"csv",      OutputType::CSV},
+        {"tsv",      OutputType::TSV},
+        {"latex",    OutputType::Latex},
+        {"markdown", OutputType::Markdown},
     }},
 };
 auto cliColumnOrder = clice::Argument {
@@ -85,434 +97,259 @@ auto cliLatexExtra = clice::Argument {
     .desc   = "addition to the output <row>:<extra>",
     .value  = std::vector<std::string>{},
 };
+auto cliJobs = clice::Argument {
+    .parent = &cliCmd,
+    .args   = {"-j", "--jobs"},
+    .desc   = "number of files processed in parallel (0: number of cores)",
+    .value  = size_t{0},
+};
+auto cliFollow = clice::Argument {
+    .parent = &cliCmd,
+    .args   = {"-f", "--follow"},
+    .desc   = "keep reading rows appended to the file, changed rows are redrawn",
+};
+auto cliFollowInterval = clice::Argument {
+    .parent = &cliCmd,
+    .args   = {"--follow-interval"},
+    .desc   = "time between checks for new rows in milliseconds",
+    .value  = size_t{250},
+};
 
-struct Rect {
-    size_t startRow{0}, endRow{std::numeric_limits<size_t>::max()};
-    size_t startCol{0}, endCol{std::numeric_limits<size_t>::max()};
+auto printOptions() -> csvtools::PrintOptions {
+    return {
+        .delimiter     = *cliDelimiter,
+        .header        = cliHeader,
+        .trim          = !cliNoTrim,
+        .outputType    = *cliOutputType,
+        .transpose     = cliTranspose,
+        .mapping       = cliUseMapping ? *cliUseMapping : std::filesystem::path{},
+        .order         = *cliColumnOrder,
+        .transforms    = *cliTransformPrint,
+        .filters       = *cliFilterPrint,
+        .customFormats = *cliCustomPrint,
+        .latexExtra    = *cliLatexExtra,
+    };
+}
 
-    bool isInRange(size_t row, size_t col) const {
-        bool valid = true;
-        valid = valid && startRow <= row && row <= endRow;
-        valid = valid && startCol <= col && col <= endCol;
-        return valid;
+auto latexAltSuffix(csvtools::PrintOptions const& options, size_t rows) -> std::unordered_map<size_t, std::string> {
+    auto altSuffix = std::unordered_map<size_t, std::string>{};
+    if (rows == 0) return altSuffix;
+    for (auto l : options.latexExtra) {
+        auto nbr = csvtools::detail::parseNextF(l);
+        auto [start, end] = csvtools::detail::parseNumberRange(nbr, 0, rows-1);
+        // only rows that are actually written
+        for (size_t row{start}; row <= std::min(end, rows-1); ++row) {
+            altSuffix[row] = "\\\\" + l;
+        }
     }
-};
+    return altSuffix;
+}
 
-        // parse number
-auto parseNumberRange(std::string s, size_t min, size_t max) -> std::tuple<size_t, size_t> {
-    if (auto iter = s.find("-"); iter != std::string::npos) {
-        auto start = s.substr(0, iter);
-        size_t startI = min;
-        auto end   = s.substr(iter+1);
-        size_t endI = max;
+// Calls cb with the format policy of the output type, so each format gets its own emitter
+template <typename CB>
+auto withOutputFormat(OutputType type, CB&& cb) {
+    namespace format = ivio::table::format;
+    switch (type) {
+    case OutputType::Table:    return cb(format::table{});
+    case OutputType::CSV:      return cb(format::csv{});
+    case OutputType::TSV:      return cb(format::tsv{});
+    case OutputType::Latex:    return cb(format::latex{});
+    case OutputType::Markdown: return cb(format::markdown{});
+    }
+    throw std::runtime_error{"unknown output type"};
+}
 
-        if (start.size()) {
-            startI = std::stoi(start);
-        }
-        if (end.size()) {
-            endI = std::stoi(end);
-        }
-        return {startI, endI};
-    } else if (s.size()) {
-        auto v = std::stoi(s);
-        return {v, v};
+template <typename Format>
+auto createEmitter(csvtools::PrintOptions const& options, std::ostream& output, size_t rows, size_t terminalLines = 0) -> ivio::table::emitter<Format> {
+    auto lineAltSuffix = std::unordered_map<size_t, std::string>{};
+    if constexpr (Format::altSuffix) {
+        lineAltSuffix = latexAltSuffix(options, rows);
+    }
+    return ivio::table::emitter<Format>{{
+        .output          = output,
+        .firstLineHeader = options.header,
+        .lineAltSuffix   = std::move(lineAltSuffix),
+        .terminalLines   = terminalLines,
+    }};
+}
+
+// Height of the terminal stdout is shown on, 0 if stdout is not a terminal
+auto terminalLines() -> size_t {
+    if (!::isatty(STDOUT_FILENO)) return 0;
+    auto ws = winsize{};
+    if (::ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) != 0 || ws.ws_row < 2) return 24;
+    return ws.ws_row;
+}
+
+// Reads the bytes appended to a file since the last call, only complete lines are parsed
+struct FileTail {
+    std::filesystem::path path;
+    csvtools::PrintOptions const& options;
+    uintmax_t offset{0};
+    std::string pending{}; // incomplete last line
+
+    // returns std::nullopt if the file was truncated
+    auto read() -> std::optional<csvtools::Table> {
+        auto size = std::filesystem::file_size(path);
+        if (size < offset) return std::nullopt;
+
+        auto table = csvtools::Table{};
+        if (size == offset) return table;
+
+        auto input = std::ifstream{path, std::ios::binary};
+        input.seekg(offset);
+        auto old = pending.size();
+        pending.resize(old + (size - offset));
+        input.read(pending.data() + old, size - offset);
+        pending.resize(old + input.gcount());
+        offset += input.gcount();
+
+        auto lineEnd = pending.rfind('\n');
+        if (lineEnd == std::string::npos) return table;
+
+        auto lines = std::istringstream{pending.substr(0, lineEnd + 1)};
+        pending = pending.substr(lineEnd + 1);
+        table = csvtools::readTable(lines, options.delimiter, options.trim);
+        return table;
     }
-    return {0, max};
 };
 
+// Prints a file and keeps printing rows appended to it. On a terminal, aligned formats
+// redraw changed rows in place, otherwise only new rows are printed.
+template <typename Format>
+[[noreturn]] void follow(csvtools::PrintOptions const& options, std::filesystem::path const& p, csvtools::Pipeline const& pipeline) {
+    while (true) {
+        auto tail    = FileTail{p, options};
+        auto view    = std::optional<csvtools::FileView>{};
+        auto emitter = createEmitter<Format>(options, std::cout, 0, terminalLines());
+
+        for (auto rows = tail.read(); rows; rows = tail.read()) {
+            auto changed = std::vector<size_t>{};
+            size_t oldSize{0};
+            if (!view && rows->size()) {
+                // columns are defined by the first rows
+                view.emplace(pipeline, std::make_shared<csvtools::Table const>(std::move(*rows)));
+                for (size_t row{0}; row < view->size(); ++row) {
+                    changed.push_back(row);
+                }
+            } else if (view && rows->size()) {
+                oldSize = view->size();
+                changed = view->append(std::move(*rows));
+            }
+
+            for (auto row : changed) {
+                auto const& entries = view->row(row);
+                if (row >= oldSize) {
+                    emitter.write({.entries = entries});
+                } else if constexpr (Format::padded) {
+                    emitter.update(row, {.entries = entries});
+                }
+            }
+            if (changed.size()) {
+                emitter.flush();
+                std::cout.flush();
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds{*cliFollowInterval});
+        }
+        // the file was truncated, start over
+        fmt::print("\n");
+    }
+}
 
 void app() {
     if (cliCmd->size() == 0) {
         fmt::print("No files given\n");
         return;
     }
-    for (auto p : *cliCmd) {
-        auto reader = ivio::csv::reader{{.input = p,
-                                         .delimiter = *cliDelimiter,
-                                         .trim      = !cliNoTrim,
-        }};
+    auto const options = printOptions();
+    auto const& files  = *cliCmd;
 
-        auto values = std::vector<std::vector<std::string>>{};
-        size_t width{};
-        for (auto record : reader) {
-            values.emplace_back(record.entries | std::ranges::to<std::vector>());
-            width = std::max(width, values.back().size());
+    if (!cliFollow) {
+        // answered by a running `csvtools serve`, if CSVTOOLS_SOCKET is set
+        if (auto ret = csvtools::runClient(options, files); ret) {
+            std::exit(*ret);
         }
+    }
+    auto const pipeline = csvtools::createPipeline(options);
 
-        // make table quadratic
-        for (size_t y{0}; y < values.size(); ++y) {
-            values[y].resize(width);
+    if (cliFollow) {
+        if (files.size() != 1) {
+            throw std::runtime_error{"--follow requires exactly one file"};
         }
-
         if (cliTranspose) {
-            auto vec = std::vector<std::vector<std::string>>{};
-            vec.resize(width, std::vector<std::string>(values.size()));
-            for (size_t y{0}; y < values.size(); ++y) {
-                for (size_t x{0}; x < width; ++x) {
-                    vec[x][y] = values[y][x];
-                }
-            }
-            width = values.size();
-            std::swap(vec, values);
+            throw std::runtime_error{"--follow can not be combined with --transpose"};
         }
-
-        auto mapping = std::unordered_map<std::string, std::string>{};
-        if (cliUseMapping) {
-            auto reader = ivio::csv::reader{{
-                .input = *cliUseMapping,
-                .delimiter = ',',
-                .trim = false,
-            }};
-            for (auto record : reader) {
-                if (record.entries.size() == 2) {
-                    mapping[record.entries[0]] = record.entries[1];
-                }
-            }
-
-            for (size_t y{0}; y < values.size(); ++y) {
-                for (size_t x{0}; x < values[y].size(); ++x) {
-                    auto& v = values[y][x];
-                    if (auto iter = mapping.find(v); iter != mapping.end()) {
-                        v = iter->second;
-                    }
-                }
-            }
+        if (options.outputType == OutputType::Latex) {
+            throw std::runtime_error{"--follow is not available for output type latex"};
         }
-        if (cliColumnOrder && cliColumnOrder->size() > 0) {
-            auto ranges = std::vector<std::tuple<std::string, size_t, size_t>>{};
-            for (auto e : *cliColumnOrder) {
-                if (e == "row") {
-                    ranges.emplace_back(e, 0, 1);
-                    continue;
-                }
-                if (e.starts_with("row ")) {
-                    auto start = std::stoi(e.substr(4));
-                    ranges.emplace_back("row", start, 1);
-                    continue;
-                }
-                if (e.starts_with("const ")) {
-                    auto v = std::stoi(e.substr(5));
-                    ranges.emplace_back("row", v, 0);
-                    continue;
-                }
-                auto [start, end] = parseNumberRange(e, 0, width-1);
-                if (start >= width || end >= width) {
-                    throw std::runtime_error{fmt::format("invalid order range {}-{} max value allowed is {}", start, end, width-1)};
-                }
-                ranges.emplace_back("range", start, end);
-            }
+        withOutputFormat(options.outputType, [&]<typename Format>(Format) {
+            follow<Format>(options, files[0], pipeline);
+        });
+    }
 
-            auto vec = std::vector<std::vector<std::string>>{};
-            for (size_t row{}; row < values.size(); ++row) {
-                auto const& in_entries = values[row];
-                auto out_entries = std::vector<std::string>{};
-                for (auto [type, start, end] : ranges) {
-                    if (type == "row") {
-                        out_entries.push_back(std::to_string(row*end + start));
-                    } else if (type == "range") {
-                        for (; start <= end; ++start) {
-                            out_entries.push_back(in_entries[start]);
-                        }
-                    }
+    // Files are processed by this thread and a pool of workers. This thread takes the file that
+    // is next in output order and emits it directly to stdout, unless a worker already started
+    // it. Only files finished by workers ahead of the output order are buffered.
+    auto results = std::vector<std::promise<std::string>>(files.size());
+    auto claimed = std::vector<std::atomic_flag>(files.size());
+    auto nextFile = std::atomic_size_t{0};
+    auto jobs = *cliJobs > 0 ? *cliJobs : std::max(size_t{1}, size_t{std::thread::hardware_concurrency()});
+    jobs = std::min(jobs, files.size());
+
+    auto workers = std::vector<std::jthread>{};
+    for (size_t i{1}; i < jobs; ++i) {
+        workers.emplace_back([&]() {
+            for (auto idx = nextFile++; idx < files.size(); idx = nextFile++) {
+                if (claimed[idx].test_and_set()) continue;
+                try {
+                    results[idx].set_value(csvtools::renderFile(options, pipeline, files[idx]));
+                } catch(...) {
+                    results[idx].set_exception(std::current_exception());
                 }
-                vec.emplace_back(std::move(out_entries));
-            }
-            std::swap(vec, values);
-            width = values[0].size();
-        }
-
-        auto parseNextF = [](std::string& s) {
-            auto iter = s.find(":");
-            if (iter == std::string::npos) {
-                throw std::runtime_error{"filter must be of format: \"<rnr>:<cnr>:<filter>:<fmt>\""};
-            }
-            auto ret = s.substr(0, iter);
-            s = s.substr(iter+1);
-            return ret;
-        };
-
-
-
-        if (cliTransformPrint) {
-            using Transform = std::function<std::string(size_t row, size_t col, std::string)>;
-            auto transformMap = std::vector<std::tuple<Rect, Transform>>{};
-            for (auto l : *cliTransformPrint) {
-                auto rowsStr      = parseNextF(l);
-                auto colsStr      = parseNextF(l);
-                auto transformStr = l;
-
-                // parse which columns to apply this to
-                auto [rstart, rend] = parseNumberRange(rowsStr, 0, std::numeric_limits<size_t>::max());
-                auto [cstart, cend] = parseNumberRange(colsStr, 0, width-1);
-                auto rect = Rect {
-                    rstart, rend,
-                    cstart, cend,
-                };
-
-
-                auto filter = [=](size_t row, size_t col, std::string s) {
-                    if (transformStr.starts_with("scale ")) {
-                        auto per = std::stod(transformStr.substr(6));
-                        auto v   = std::stod(s);
-                        s = fmt::format("{}", v*per);
-                    } else if (transformStr == "inv") {
-                        auto v   = std::stod(s);
-                        s = fmt::format("{}", 1./v);
-                    } else if (transformStr == "log10") {
-                        auto v   = std::stod(s);
-                        s = fmt::format("{}", std::log10(v));
-                    }
-
-
-                    return s;
-                };
-
-                transformMap.emplace_back(rect, filter);
             }
+        });
+    }
 
-            for (size_t row{0}; row < values.size(); ++row) {
-                auto& entries = values[row];
-                for (size_t col{0}; col < entries.size(); ++col) {
-                    auto& e = entries[col];
-                    for (auto [rect, transform] : transformMap) {
-                        if (!rect.isInRange(row, col)) continue;
-                        try {
-                            e = transform(row, col, e);
-                        } catch(...){}
-                    }
-                }
-            }
+    for (size_t idx{0}; idx < files.size(); ++idx) {
+        if (!claimed[idx].test_and_set()) {
+            csvtools::emitFile(options, pipeline, files[idx], std::cout);
+        } else {
+            std::cout << results[idx].get_future().get();
         }
+    }
+}
+}
 
-        auto cachedValues = std::unordered_map<std::string, double>{};
-
-        auto cachedValue_fetch_or_run = [&](std::string id, auto cb) {
-            auto iter = cachedValues.find(id);
-            if (iter == cachedValues.end()) {
-                auto v = cb();
-                cachedValues[id] = v;
-                iter = cachedValues.find(id);
-            }
-            return iter->second;
-        };
-        auto cachedValue_fetch_or_cacc = [&](size_t col, size_t start, size_t end, auto init, auto bin) {
-            for (size_t i{start}; i <= end; ++i) {
-                auto& entries = values[i];
-                auto v = std::stod(entries[col]);
-                init = bin(v, init);
-            }
-            return init;
-        };
-
-        auto cachedValue_fetch_or_racc = [&](size_t row, size_t start, size_t end, auto init, auto bin) {
-            for (size_t i{start}; i < std::min(values[row].size(), end); ++i) {
-                auto const& e = values[row][i];
-                auto v = std::stod(e);
-                init = bin(v, init);
-            }
-            return init;
-        };
-
-        auto cachedValue_cmin = [&](size_t col, size_t start, size_t end) -> double {
-            return cachedValue_fetch_or_run(fmt::format("cmin{}:{}-{}", col, start, end), [&]() {
-                return cachedValue_fetch_or_cacc(col, start, end, std::numeric_limits<double>::max(), [](double lhs, double rhs) {
-                    return std::min(lhs, rhs);
-                });
-            });
-        };
-
-        auto cachedValue_cmax = [&](size_t col, size_t start, size_t end) -> double {
-            return cachedValue_fetch_or_run(fmt::format("cmax{}:{}-{}", col, start, end), [&]() {
-                return cachedValue_fetch_or_cacc(col, start, end, std::numeric_limits<double>::lowest(), [](double lhs, double rhs) {
-                    return std::max(lhs, rhs);
-                });
-            });
-        };
+namespace csvtools {
+
+auto createPipeline(PrintOptions const& options) -> Pipeline {
+    return Pipeline{{
+        .transpose     = options.transpose,
+        .mapping       = options.mapping.empty() ? Mapping{} : loadMapping(options.mapping),
+        .order         = options.order,
+        .transforms    = options.transforms,
+        .filters       = options.filters,
+        .customFormats = options.customFormats,
+    }};
+}
 
-        auto cachedValue_rmin = [&](size_t row, size_t start, size_t end) -> double {
-            return cachedValue_fetch_or_run(fmt::format("rmin{}:{}-{}", row, start, end), [&]() {
-                return cachedValue_fetch_or_racc(row, start, end, std::numeric_limits<double>::max(), [](double lhs, double rhs) {
-                    return std::min(lhs, rhs);
-                });
-            });
-        };
+void emitFile(PrintOptions const& options, Pipeline const& pipeline, std::filesystem::path const& path, std::ostream& output) {
+    auto view = FileView{pipeline, loadTable(path, options.delimiter, options.trim)};
 
-        auto cachedValue_rmax = [&](size_t row, size_t start, size_t end) -> double {
-            return cachedValue_fetch_or_run(fmt::format("rmax{}:{}-{}", row, start, end), [&]() {
-                return cachedValue_fetch_or_racc(row, start, end, std::numeric_limits<double>::lowest(), [](double lhs, double rhs) {
-                    return std::max(lhs, rhs);
-                });
+    withOutputFormat(options.outputType, [&]<typename Format>(Format) {
+        auto emitter = createEmitter<Format>(options, output, view.size());
+        for (size_t row{0}; row < view.size(); ++row) {
+            emitter.write({
+                .entries = view.row(row),
             });
-        };
-
-        if (cliFilterPrint) {
-            using Filter = std::function<std::string(size_t row, size_t col, std::string)>;
-            auto filterMap = std::vector<std::tuple<Rect, Filter>>{};
-            for (auto l : *cliFilterPrint) {
-                auto rowsStr   = parseNextF(l);
-                auto colsStr   = parseNextF(l);
-                auto filterStr = parseNextF(l);
-                auto suffix    = l;
-
-                // parse which columns to apply this to
-                auto [rstart, rend] = parseNumberRange(rowsStr, 0, std::numeric_limits<size_t>::max());
-                auto [cstart, cend] = parseNumberRange(colsStr, 0, width-1);
-                auto rect = Rect {
-                    rstart, rend,
-                    cstart, cend,
-                };
-
-
-                auto filter = [=](size_t row, size_t col, std::string s) {
-                    if (filterStr == "true") {
-                        s = fmt::format(fmt::runtime(suffix), s);
-                    }
-                    if (filterStr == "cmin") {
-                        if (std::stod(s) == cachedValue_cmin(col, rstart, rend)) {
-                            s = fmt::format(fmt::runtime(suffix), s);
-                        }
-                    }
-                    if (filterStr == "cmax") {
-                        if (std::stod(s) == cachedValue_cmax(col, rstart, rend)) {
-                            s = fmt::format(fmt::runtime(suffix), s);
-                        }
-                    }
-                    if (filterStr.starts_with("cmin ")) {
-                        auto per = std::stod(filterStr.substr(5));
-                        if (std::stod(s)*per <= cachedValue_cmin(col, rstart, rend)) {
-                            s = fmt::format(fmt::runtime(suffix), s);
-                        }
-                    }
-                    if (filterStr.starts_with("cmax ")) {
-                        auto per = std::stod(filterStr.substr(5));
-                        if (std::stod(s) >= cachedValue_cmax(col, rstart, rend)*per) {
-                            s = fmt::format(fmt::runtime(suffix), s);
-                        }
-                    }
-                    if (filterStr == "rmin") {
-                        if (std::stod(s) == cachedValue_rmin(row, cstart, cend)) {
-                            s = fmt::format(fmt::runtime(suffix), s);
-                        }
-                    }
-                    if (filterStr == "rmax") {
-                        if (std::stod(s) == cachedValue_rmax(row, cstart, cend)) {
-                            s = fmt::format(fmt::runtime(suffix), s);
-                        }
-                    }
-                    if (filterStr.starts_with("rmin ")) {
-                        auto per = std::stod(filterStr.substr(5));
-                        if (std::stod(s)*per <= cachedValue_rmin(row, cstart, cend)) {
-                            s = fmt::format(fmt::runtime(suffix), s);
-                        }
-                    }
-                    if (filterStr.starts_with("rmax ")) {
-                        auto per = std::stod(filterStr.substr(5));
-                        if (std::stod(s) >= cachedValue_rmax(row, cstart, cend)*per) {
-                            s = fmt::format(fmt::runtime(suffix), s);
-                        }
-                    }
-                    if (filterStr == "float") {
-                        auto v = std::stod(s);
-                        s = fmt::format(fmt::runtime(suffix), v);
-                    }
-
-                    return s;
-                };
-
-                filterMap.emplace_back(rect, filter);
-            }
-
-            for (size_t row{0}; row < values.size(); ++row) {
-                auto& entries = values[row];
-                for (size_t col{0}; col < entries.size(); ++col) {
-                    auto& e = entries[col];
-                    for (auto [rect, filter] : filterMap) {
-                        if (!rect.isInRange(row, col)) continue;
-                        try {
-                            e = filter(row, col, e);
-                        } catch(...){}
-                    }
-                }
-            }
         }
+    });
+}
 
-
-
-        if (cliCustomPrint) {
-            auto customFmt = std::unordered_map<size_t, std::string>{};
-            for (auto l : *cliCustomPrint) {
-                auto iter = l.find(":");
-                if (iter == std::string::npos) {
-                    throw std::runtime_error{"custom format must be of format: \"<nr>:<fmt>\""};
-                }
-                auto prefix = l.substr(0, iter);
-                auto suffix = l.substr(iter+1);
-                if (prefix.size()) {
-                    auto col = std::stoi(prefix);
-                    customFmt[col] = suffix;
-                } else {
-                    for (size_t i{0}; i < width; ++i) {
-                        customFmt[i] = suffix;
-                    }
-                }
-            }
-            for (auto& entries : values) {
-                for (size_t col{0}; col < entries.size(); ++col) {
-                    auto& e = entries[col];
-                    if (auto iter = customFmt.find(col); iter != customFmt.end()) {
-                        e = fmt::format(fmt::runtime(iter->second), e);
-                    }
-                }
-            }
-        }
-
-        if (*cliOutputType == OutputType::Table) {
-            auto writer = ivio::table::writer {{
-                .output = std::cout,
-                .firstLineHeader = cliHeader,
-            }};
-            for (auto& record : values) {
-                writer.write({
-                    .entries = record,
-                });
-            }
-        } else if (*cliOutputType == OutputType::CSV) {
-            auto writer = ivio::table::writer {{
-                .output = std::cout,
-                .linePrefix      = "",
-                .lineSuffix      = "",
-                .entrySeparator  = ", ",
-                .firstLineHeader = cliHeader,
-            }};
-            for (auto& record : values) {
-                writer.write({
-                    .entries = record,
-                });
-            }
-        } else if (*cliOutputType == OutputType::Latex) {
-            auto altSuffix = std::unordered_map<size_t, std::string>{};
-            for (auto l : *cliLatexExtra) {
-                auto nbr = parseNextF(l);
-                auto [start, end] = parseNumberRange(nbr, 0, values.size()-1);
-                for (size_t row{start}; row <= end; ++row) {
-                    altSuffix[row] = "\\\\" + l;
-                }
-            }
-
-            auto writer = ivio::table::writer {{
-                .output = std::cout,
-                .linePrefix      = "",
-                .lineSuffix      = "\\\\",
-                .lineAltSuffix   = std::move(altSuffix),
-                .entrySeparator  = " & ",
-                .firstLineHeader = false,
-            }};
-            for (auto& record : values) {
-                writer.write({
-                    .entries = record,
-                });
-            }
-        }
-    }
+auto renderFile(PrintOptions const& options, Pipeline const& pipeline, std::filesystem::path const& path) -> std::string {
+    auto output = std::ostringstream{};
+    emitFile(options, pipeline, path, output);
+    return std::move(output).str();
 }
+
 }
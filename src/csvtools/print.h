@@ -0,0 +1,40 @@
+// SPDX-FileCopyrightText: 2023 Gottlieb+Freitag <info@gottliebtfreitag.de>
+// SPDX-License-Identifier: CC0-1.0
+#pragma once
+
+#include "pipeline.h"
+
+#include <filesystem>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace csvtools {
+
+enum class OutputType { Table, CSV, TSV, Latex, Markdown };
+
+// Options of `csvtools print` that define how each file is printed
+struct PrintOptions {
+    char delimiter{','};
+    bool header{false};
+    bool trim{true};
+    OutputType outputType{OutputType::Table};
+    bool transpose{false};
+    std::filesystem::path mapping; // empty: no mapping
+    std::vector<std::string> order;
+    std::vector<std::string> transforms;
+    std::vector<std::string> filters;
+    std::vector<std::string> customFormats;
+    std::vector<std::string> latexExtra;
+};
+
+auto createPipeline(PrintOptions const& options) -> Pipeline;
+
+// Loads (through the table cache), transforms and writes a single file to output,
+// non-padded formats are written while the rows are rendered
+void emitFile(PrintOptions const& options, Pipeline const& pipeline, std::filesystem::path const& path, std::ostream& output);
+
+// Same as emitFile, but returns the output
+auto renderFile(PrintOptions const& options, Pipeline const& pipeline, std::filesystem::path const& path) -> std::string;
+
+}
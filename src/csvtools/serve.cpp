@@ -0,0 +1,483 @@
+// SPDX-FileCopyrightText: 2023 Gottlieb+Freitag <info@gottliebtfreitag.de>
+// SPDX-License-Identifier: CC0-1.0
+#include "serve.h"
+#include "table_cache.h"
+
+#include <clice/clice.h>
+#include <cerrno>
+#include <condition_variable>
+#include <csignal>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <fmt/format.h>
+#include <fmt/std.h>
+#include <iostream>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+void app();
+auto cliCmd = clice::Argument {
+    .args   = "serve",
+    .desc   = "answers print requests on a unix socket, parsed files and results are cached between requests. Clients: csvtools print with CSVTOOLS_SOCKET set",
+    .value  = std::filesystem::path{"/tmp/csvtools.sock"},
+    .cb     = &app,
+};
+auto cliCacheSize = clice::Argument {
+    .parent = &cliCmd,
+    .args   = {"--cache-size"},
+    .desc   = "number of parsed files, compiled pipelines and rendered files kept in memory",
+    .value  = size_t{64},
+};
+auto cliJobs = clice::Argument {
+    .parent = &cliCmd,
+    .args   = {"-j", "--jobs"},
+    .desc   = "number of requests answered in parallel (0: number of cores)",
+    .value  = size_t{0},
+};
+auto cliTimeout = clice::Argument {
+    .parent = &cliCmd,
+    .args   = {"--timeout"},
+    .desc   = "seconds a client may take to send its request or to receive a chunk of the answer",
+    .value  = size_t{10},
+};
+
+auto systemError(std::string_view what) -> std::runtime_error {
+    return std::runtime_error{fmt::format("{}: {}", what, std::strerror(errno))};
+}
+
+auto socketAddress(std::filesystem::path const& path) -> sockaddr_un {
+    auto addr = sockaddr_un{};
+    addr.sun_family = AF_UNIX;
+    auto const& s = path.native();
+    if (s.size() >= sizeof(addr.sun_path)) {
+        throw std::runtime_error{fmt::format("socket path {} is too long", path)};
+    }
+    std::ranges::copy(s, addr.sun_path);
+    return addr;
+}
+
+void writeAll(int fd, std::string_view data) {
+    while (data.size()) {
+        auto r = ::write(fd, data.data(), data.size());
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) throw systemError("write");
+        data = data.substr(r);
+    }
+}
+
+// reads until the other side closes its writing side, at most maxSize bytes
+auto readAll(int fd, size_t maxSize) -> std::string {
+    auto data = std::string{};
+    char buffer[4096];
+    while (true) {
+        auto r = ::read(fd, buffer, sizeof(buffer));
+        if (r < 0 && errno == EINTR) continue;
+        if (r < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            throw std::runtime_error{"timeout while reading the request"};
+        }
+        if (r < 0) throw systemError("read");
+        if (r == 0) return data;
+        if (data.size() + r > maxSize) {
+            throw std::runtime_error{"request too large"};
+        }
+        data.append(buffer, r);
+    }
+}
+
+// reads exactly size bytes, returns false if the connection ended before
+bool readExact(int fd, char* data, size_t size) {
+    while (size) {
+        auto r = ::read(fd, data, size);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) return false;
+        data += r;
+        size -= r;
+    }
+    return true;
+}
+
+// A request is a list of strings, each terminated by '\0', lists are preceded by their length.
+// The client closes its writing side after the request.
+constexpr auto ProtocolVersion = std::string_view{"csvtools-print-1"};
+constexpr size_t MaxRequestSize = 1<<20;
+
+struct Request {
+    csvtools::PrintOptions options;
+    std::vector<std::filesystem::path> files;
+};
+
+// the options part of a request, also used as cache key
+auto encodeOptions(csvtools::PrintOptions const& o) -> std::string {
+    auto data = std::string{};
+    auto add = [&](std::string_view s) {
+        data += s;
+        data += '\0';
+    };
+    auto addList = [&](std::vector<std::string> const& list) {
+        add(std::to_string(list.size()));
+        for (auto const& s : list) add(s);
+    };
+    add(std::to_string(static_cast<int>(o.delimiter)));
+    add(o.header    ? "1" : "0");
+    add(o.trim      ? "1" : "0");
+    add(std::to_string(static_cast<int>(o.outputType)));
+    add(o.transpose ? "1" : "0");
+    add(o.mapping.native());
+    addList(o.order);
+    addList(o.transforms);
+    addList(o.filters);
+    addList(o.customFormats);
+    addList(o.latexExtra);
+    return data;
+}
+
+auto encodeRequest(Request const& request) -> std::string {
+    auto data = std::string{ProtocolVersion};
+    data += '\0';
+    data += std::to_string(request.files.size());
+    data += '\0';
+    for (auto const& p : request.files) {
+        data += p.native();
+        data += '\0';
+    }
+    return data + encodeOptions(request.options);
+}
+
+auto decodeRequest(std::string_view data) -> Request {
+    auto next = [&]() {
+        auto end = data.find('\0');
+        if (end == std::string_view::npos) {
+            throw std::runtime_error{"malformed request"};
+        }
+        auto s = std::string{data.substr(0, end)};
+        data = data.substr(end + 1);
+        return s;
+    };
+    auto nextList = [&]() {
+        auto list = std::vector<std::string>(std::stoul(next()));
+        for (auto& s : list) s = next();
+        return list;
+    };
+    if (next() != ProtocolVersion) {
+        throw std::runtime_error{"unsupported request, client and server versions differ"};
+    }
+    auto request = Request{};
+    auto& o = request.options;
+    request.files.resize(std::stoul(next()));
+    for (auto& p : request.files) p = next();
+    o.delimiter     = static_cast<char>(std::stoi(next()));
+    o.header        = next() == "1";
+    o.trim          = next() == "1";
+    o.outputType    = static_cast<csvtools::OutputType>(std::stoi(next()));
+    o.transpose     = next() == "1";
+    o.mapping       = next();
+    o.order         = nextList();
+    o.transforms    = nextList();
+    o.filters       = nextList();
+    o.customFormats = nextList();
+    o.latexExtra    = nextList();
+    return request;
+}
+
+// The response is a sequence of frames: <tag><length as uint32_t><data>.
+// The last frame carries the exit status.
+enum class Frame : char { Stdout = 'o', Stderr = 'e', Exit = 'x' };
+constexpr size_t MaxFrameSize = 1<<20;
+
+void writeFrame(int fd, Frame tag, std::string_view data) {
+    do {
+        auto chunk = data.substr(0, MaxFrameSize);
+        auto size  = static_cast<uint32_t>(chunk.size());
+        char header[1 + sizeof(size)];
+        header[0] = static_cast<char>(tag);
+        std::memcpy(header + 1, &size, sizeof(size));
+        writeAll(fd, {header, sizeof(header)});
+        writeAll(fd, chunk);
+        data = data.substr(chunk.size());
+    } while (data.size());
+}
+
+// Modification time and size of a file, cached results are only used while they match
+struct FileStamp {
+    std::filesystem::file_time_type mtime;
+    uintmax_t size;
+
+    bool operator==(FileStamp const&) const = default;
+};
+
+// returns std::nullopt if the file can not be inspected, results depending on it are not cached
+auto fileStamp(std::filesystem::path const& path) -> std::optional<FileStamp> {
+    auto ec    = std::error_code{};
+    auto mtime = std::filesystem::last_write_time(path, ec);
+    auto size  = std::filesystem::file_size(path, ec);
+    if (ec) return std::nullopt;
+    return FileStamp{mtime, size};
+}
+
+// Least recently used cache of results that depend on files, see loadTable for parsed files
+template <typename Value>
+struct ResultCache {
+    struct Entry {
+        std::vector<FileStamp> stamps;
+        Value value;
+        std::list<std::string>::iterator lruPos;
+    };
+
+    std::mutex mutex;
+    size_t capacity{0};
+    std::map<std::string, Entry> entries;
+    std::list<std::string> lru; // most recently used first
+
+    auto find(std::string const& key, std::vector<FileStamp> const& stamps) -> std::optional<Value> {
+        auto g = std::lock_guard{mutex};
+        auto iter = entries.find(key);
+        if (iter == entries.end()) return std::nullopt;
+        auto& entry = iter->second;
+        if (entry.stamps != stamps) {
+            lru.erase(entry.lruPos);
+            entries.erase(iter);
+            return std::nullopt;
+        }
+        lru.splice(lru.begin(), lru, entry.lruPos);
+        return entry.value;
+    }
+
+    void insert(std::string const& key, std::vector<FileStamp> stamps, Value value) {
+        auto g = std::lock_guard{mutex};
+        if (capacity == 0 || entries.contains(key)) return;
+        lru.push_front(key);
+        entries.try_emplace(key, Entry{std::move(stamps), std::move(value), lru.begin()});
+        while (entries.size() > capacity) {
+            entries.erase(lru.back());
+            lru.pop_back();
+        }
+    }
+};
+
+// compiled pipelines by encoded options, they depend on the mapping file
+auto pipelineCache = ResultCache<std::shared_ptr<csvtools::Pipeline const>>{};
+// rendered files by encoded options and path, they depend on the file and the mapping file
+auto renderedCache = ResultCache<std::shared_ptr<std::string const>>{};
+
+auto cachedPipeline(csvtools::PrintOptions const& options, std::string const& key, std::vector<FileStamp> const& stamps) -> std::shared_ptr<csvtools::Pipeline const> {
+    if (auto pipeline = pipelineCache.find(key, stamps)) {
+        return *pipeline;
+    }
+    auto pipeline = std::make_shared<csvtools::Pipeline const>(csvtools::createPipeline(options));
+    pipelineCache.insert(key, stamps, pipeline);
+    return pipeline;
+}
+
+void answerRequest(int connection) {
+    int status = 0;
+    try {
+        auto request = decodeRequest(readAll(connection, MaxRequestSize));
+        auto options = encodeOptions(request.options);
+
+        // stamps are taken before loading, a file changing meanwhile only causes a reload next time
+        auto pipelineStamps = std::vector<FileStamp>{};
+        bool cacheable = true;
+        if (!request.options.mapping.empty()) {
+            auto stamp = fileStamp(request.options.mapping);
+            cacheable = stamp.has_value();
+            if (stamp) pipelineStamps.push_back(*stamp);
+        }
+        auto pipeline = std::shared_ptr<csvtools::Pipeline const>{};
+        auto getPipeline = [&]() -> csvtools::Pipeline const& {
+            if (!pipeline) {
+                pipeline = cacheable ? cachedPipeline(request.options, options, pipelineStamps)
+                                     : std::make_shared<csvtools::Pipeline const>(csvtools::createPipeline(request.options));
+            }
+            return *pipeline;
+        };
+
+        for (auto const& p : request.files) {
+            auto key   = options + p.native();
+            auto stamp = fileStamp(p);
+            if (!cacheable || !stamp) {
+                writeFrame(connection, Frame::Stdout, csvtools::renderFile(request.options, getPipeline(), p));
+                continue;
+            }
+            auto stamps = pipelineStamps;
+            stamps.push_back(*stamp);
+            auto rendered = renderedCache.find(key, stamps);
+            if (!rendered) {
+                rendered = std::make_shared<std::string const>(csvtools::renderFile(request.options, getPipeline(), p));
+                renderedCache.insert(key, std::move(stamps), *rendered);
+            }
+            writeFrame(connection, Frame::Stdout, **rendered);
+        }
+    } catch (std::exception const& e) {
+        writeFrame(connection, Frame::Stderr, fmt::format("{}\n", e.what()));
+        status = 1;
+    }
+    writeFrame(connection, Frame::Exit, std::to_string(status));
+}
+
+// Accepted connections waiting for a worker, accepting blocks while the queue is full
+struct ConnectionQueue {
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<int> connections;
+    size_t capacity;
+    bool closed{false};
+
+    void push(int connection) {
+        {
+            auto lock = std::unique_lock{mutex};
+            cv.wait(lock, [&] { return connections.size() < capacity; });
+            connections.push_back(connection);
+        }
+        cv.notify_all();
+    }
+
+    // returns std::nullopt after the queue was closed
+    auto pop() -> std::optional<int> {
+        auto connection = std::optional<int>{};
+        {
+            auto lock = std::unique_lock{mutex};
+            cv.wait(lock, [&] { return closed || connections.size(); });
+            if (connections.empty()) return std::nullopt;
+            connection = connections.front();
+            connections.pop_front();
+        }
+        cv.notify_all();
+        return connection;
+    }
+
+    void close() {
+        {
+            auto lock = std::unique_lock{mutex};
+            closed = true;
+        }
+        cv.notify_all();
+    }
+};
+
+void app() {
+    auto const& path = *cliCmd;
+    auto jobs = *cliJobs > 0 ? *cliJobs : std::max(size_t{1}, size_t{std::thread::hardware_concurrency()});
+    csvtools::setTableCacheCapacity(*cliCacheSize);
+    pipelineCache.capacity = *cliCacheSize;
+    renderedCache.capacity = *cliCacheSize;
+    std::signal(SIGPIPE, SIG_IGN);
+
+    auto listenFd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listenFd < 0) throw systemError("socket");
+    auto addr = socketAddress(path);
+    if (std::filesystem::is_socket(path)) {
+        std::filesystem::remove(path);
+    }
+    if (::bind(listenFd, reinterpret_cast<sockaddr const*>(&addr), sizeof(addr)) != 0) {
+        throw systemError(fmt::format("bind {}", path));
+    }
+    if (::listen(listenFd, SOMAXCONN) != 0) {
+        throw systemError("listen");
+    }
+    fmt::print(stderr, "listening on {}\n", path);
+
+    // requests are answered by a fixed pool of workers
+    auto queue = ConnectionQueue{.capacity = 4 * jobs};
+    auto workers = std::vector<std::jthread>{};
+    for (size_t i{0}; i < jobs; ++i) {
+        workers.emplace_back([&]() {
+            while (auto connection = queue.pop()) {
+                try {
+                    answerRequest(*connection);
+                } catch(...) {} // the client is gone
+                ::close(*connection);
+            }
+        });
+    }
+
+    try {
+        while (true) {
+            auto connection = ::accept(listenFd, nullptr, nullptr);
+            if (connection < 0) {
+                if (errno == EINTR || errno == ECONNABORTED) continue;
+                throw systemError("accept");
+            }
+            // a client that does not send its request or does not read the answer can not block a worker
+            auto timeout = timeval{.tv_sec = static_cast<time_t>(*cliTimeout), .tv_usec = 0};
+            ::setsockopt(connection, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+            ::setsockopt(connection, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+            queue.push(connection);
+        }
+    } catch(...) {
+        queue.close();
+        throw;
+    }
+}
+}
+
+namespace csvtools {
+
+auto runClient(PrintOptions const& options, std::vector<std::filesystem::path> const& files) -> std::optional<int> {
+    auto socketPath = std::getenv("CSVTOOLS_SOCKET");
+    if (!socketPath) {
+        return std::nullopt;
+    }
+
+    // the server has a different working directory
+    auto request = Request{options, {}};
+    for (auto const& p : files) {
+        request.files.push_back(std::filesystem::absolute(p));
+    }
+    if (!options.mapping.empty()) {
+        request.options.mapping = std::filesystem::absolute(options.mapping);
+    }
+
+    auto fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return std::nullopt;
+    bool received{false}; // once output was received, the request can not be repeated locally
+    try {
+        auto addr = socketAddress(socketPath);
+        if (::connect(fd, reinterpret_cast<sockaddr const*>(&addr), sizeof(addr)) != 0) {
+            ::close(fd);
+            return std::nullopt;
+        }
+        writeAll(fd, encodeRequest(request));
+        ::shutdown(fd, SHUT_WR);
+        std::cout.flush();
+
+        auto data = std::string{};
+        while (true) {
+            char header[1 + sizeof(uint32_t)];
+            if (!readExact(fd, header, sizeof(header))) break;
+            auto size = uint32_t{};
+            std::memcpy(&size, header + 1, sizeof(size));
+            data.resize(size);
+            if (!readExact(fd, data.data(), size)) break;
+            received = true;
+
+            switch (static_cast<Frame>(header[0])) {
+            case Frame::Stdout: writeAll(STDOUT_FILENO, data); break;
+            case Frame::Stderr: writeAll(STDERR_FILENO, data); break;
+            case Frame::Exit:
+                ::close(fd);
+                return std::stoi(data);
+            }
+        }
+    } catch(...) {}
+    ::close(fd);
+    if (!received) {
+        return std::nullopt;
+    }
+    fmt::print(stderr, "lost connection to csvtools serve on {}\n", socketPath);
+    return 1;
+}
+
+}
@@ -0,0 +1,18 @@
+// SPDX-FileCopyrightText: 2023 Gottlieb+Freitag <info@gottliebtfreitag.de>
+// SPDX-License-Identifier: CC0-1.0
+#pragma once
+
+#include "print.h"
+
+#include <filesystem>
+#include <optional>
+#include <vector>
+
+namespace csvtools {
+
+// If CSVTOOLS_SOCKET is set, the files are printed by a running `csvtools serve`.
+// Output and errors are written to stdout and stderr, returns the exit status of the request
+// or std::nullopt if no server is reachable and the files should be printed locally.
+auto runClient(PrintOptions const& options, std::vector<std::filesystem::path> const& files) -> std::optional<int>;
+
+}
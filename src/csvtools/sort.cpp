@@ -0,0 +1,506 @@
+// SPDX-FileCopyrightText: 2023 Gottlieb+Freitag <info@gottliebtfreitag.de>
+// SPDX-License-Identifier: CC0-1.0
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <charconv>
+#include <clice/clice.h>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <fmt/format.h>
+#include <fmt/std.h>
+#include <fstream>
+#include <future>
+#include <ivio/csv/reader.h>
+#include "table/csv_writer.h"
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <thread>
+#include <unistd.h>
+
+namespace {
+void app();
+auto cliCmd = clice::Argument {
+    .args   = "sort",
+    .desc   = "sorts csv tables, larger than memory tables are sorted via temporary files",
+    .value  = std::vector<std::filesystem::path>{},
+    .cb     = &app,
+};
+auto cliHeader = clice::Argument {
+    .parent = &cliCmd,
+    .args   = {"-h", "--header"},
+    .desc   = "treats the first line as a header, it stays the first line",
+};
+auto cliDelimiter = clice::Argument {
+    .parent = &cliCmd,
+    .args   = {"-d", "--delimiter"},
+    .desc   = "delimiter used in input file",
+    .value  = ',',
+};
+auto cliNoTrim = clice::Argument {
+    .parent = &cliCmd,
+    .args   = {"--no-trim"},
+    .desc   = "do not trim white spaces around entries",
+};
+auto cliKeys = clice::Argument {
+    .parent = &cliCmd,
+    .args   = {"-k", "--key"},
+    .desc   = "column to sort by, format: <col>[n][r], n: numeric, r: reverse. If no key given, the whole row is compared",
+    .value  = std::vector<std::string>{},
+};
+auto cliMaxMemory = clice::Argument {
+    .parent = &cliCmd,
+    .args   = {"--max-memory"},
+    .desc   = "memory budget in MiB, if exceeded sorted runs are spilled to temporary files",
+    .value  = size_t{1024},
+};
+auto cliTmpDir = clice::Argument {
+    .parent = &cliCmd,
+    .args   = {"--tmp"},
+    .desc   = "directory in which a private directory for temporary files is created",
+    .value  = std::filesystem::path{},
+};
+auto cliJobs = clice::Argument {
+    .parent = &cliCmd,
+    .args   = {"-j", "--jobs"},
+    .desc   = "number of runs sorted in parallel (0: number of cores)",
+    .value  = size_t{0},
+};
+
+struct Key {
+    size_t col;
+    bool numeric{false};
+    bool reverse{false};
+};
+
+struct Row {
+    std::vector<std::string> entries;
+    std::vector<double> numbers; // parsed values of the numeric keys
+
+    // approximation of the memory used by this row
+    auto memoryUsage() const -> size_t {
+        auto size = sizeof(Row) + numbers.capacity() * sizeof(double);
+        for (auto const& e : entries) {
+            size += sizeof(std::string) + (e.capacity() > 15 ? e.capacity() : 0);
+        }
+        return size;
+    }
+};
+
+auto parseKey(std::string s) -> Key {
+    auto key = Key{};
+    while (s.size() && (s.back() == 'n' || s.back() == 'r')) {
+        if (s.back() == 'n') key.numeric = true;
+        if (s.back() == 'r') key.reverse = true;
+        s.pop_back();
+    }
+    auto [ptr, ec] = std::from_chars(s.data(), s.data() + s.size(), key.col);
+    if (ec != std::errc{} || ptr != s.data() + s.size()) {
+        throw std::runtime_error{"key must be of format: \"<col>[n][r]\""};
+    }
+    return key;
+}
+
+auto parseNumber(std::string const& s) -> double {
+    double v{};
+    auto [ptr, ec] = std::from_chars(s.data(), s.data() + s.size(), v);
+    if (ec != std::errc{} || ptr != s.data() + s.size()) {
+        return std::numeric_limits<double>::quiet_NaN();
+    }
+    return v;
+}
+
+struct Comparator {
+    std::vector<Key> keys;
+
+    void prepare(Row& row) const {
+        row.numbers.clear();
+        for (auto const& key : keys) {
+            if (!key.numeric) continue;
+            row.numbers.push_back(key.col < row.entries.size() ? parseNumber(row.entries[key.col]) : std::numeric_limits<double>::quiet_NaN());
+        }
+    }
+
+    // three way comparison, numbers are ordered before non numbers
+    auto compare(Row const& lhs, Row const& rhs) const -> int {
+        if (keys.empty()) {
+            auto r = lhs.entries <=> rhs.entries;
+            return r < 0 ? -1 : (r > 0 ? 1 : 0);
+        }
+        static auto const empty = std::string{};
+        size_t numIdx{0};
+        for (auto const& key : keys) {
+            auto const& l = key.col < lhs.entries.size() ? lhs.entries[key.col] : empty;
+            auto const& r = key.col < rhs.entries.size() ? rhs.entries[key.col] : empty;
+            int c{0};
+            if (key.numeric) {
+                auto lv = lhs.numbers[numIdx];
+                auto rv = rhs.numbers[numIdx];
+                numIdx += 1;
+                if (std::isnan(lv) != std::isnan(rv)) c = std::isnan(lv) ? 1 : -1;
+                else if (lv < rv) c = -1;
+                else if (lv > rv) c = 1;
+            }
+            if (c == 0) {
+                c = l.compare(r);
+            }
+            if (c != 0) {
+                c = c < 0 ? -1 : 1;
+                return key.reverse ? -c : c;
+            }
+        }
+        return 0;
+    }
+
+    bool operator()(Row const& lhs, Row const& rhs) const {
+        return compare(lhs, rhs) < 0;
+    }
+};
+
+// A sorted sequence of rows, either kept in memory or spilled into a temporary file
+struct Run {
+    virtual ~Run() = default;
+    // called before the run takes part in a merge
+    virtual void open() {}
+    // current row, nullptr if exhausted
+    virtual auto head() const -> Row const* = 0;
+    virtual void next() = 0;
+};
+
+struct MemoryRun : Run {
+    std::vector<Row> rows;
+    size_t pos{0};
+
+    MemoryRun(std::vector<Row> rows_)
+        : rows{std::move(rows_)}
+    {}
+
+    auto head() const -> Row const* override {
+        return pos < rows.size() ? &rows[pos] : nullptr;
+    }
+    void next() override {
+        pos += 1;
+    }
+};
+
+// A directory only accessible by this process (mkdtemp), it is removed with all run files in it
+struct TempDirectory {
+    std::filesystem::path path;
+
+    explicit TempDirectory(std::filesystem::path const& parent) {
+        auto pattern = (parent / "csvtools-sort-XXXXXX").string();
+        if (!::mkdtemp(pattern.data())) {
+            throw std::runtime_error{fmt::format("failed creating temporary directory in {}: {}", parent, std::strerror(errno))};
+        }
+        path = pattern;
+    }
+    TempDirectory(TempDirectory const&) = delete;
+    ~TempDirectory() {
+        auto ec = std::error_code{};
+        std::filesystem::remove_all(path, ec);
+    }
+};
+
+// Size of the stream buffer of each run file that is read or written
+constexpr size_t RunBufferSize = 1<<20;
+
+// Writes a run file, stored as: <entry count> followed by <length><bytes> for each entry.
+// The file is removed again if it is not finished.
+struct RunWriter {
+    std::filesystem::path path;
+    std::vector<char> buffer;
+    std::ofstream output;
+    bool finished{false};
+
+    RunWriter(std::filesystem::path path_)
+        : path{std::move(path_)}
+        , buffer(RunBufferSize)
+    {
+        output.rdbuf()->pubsetbuf(buffer.data(), buffer.size());
+        output.open(path, std::ios::binary);
+    }
+    ~RunWriter() {
+        if (!finished) {
+            output.close();
+            auto ec = std::error_code{};
+            std::filesystem::remove(path, ec);
+        }
+    }
+
+    void write(Row const& row) {
+        auto writeInt = [&](uint64_t v) {
+            output.write(reinterpret_cast<char const*>(&v), sizeof(v));
+        };
+        writeInt(row.entries.size());
+        for (auto const& e : row.entries) {
+            writeInt(e.size());
+            output.write(e.data(), e.size());
+        }
+        if (!output) {
+            throw std::runtime_error{fmt::format("failed writing temporary file {}", path)};
+        }
+    }
+
+    void finish() {
+        output.close();
+        if (!output) {
+            throw std::runtime_error{fmt::format("failed writing temporary file {}", path)};
+        }
+        finished = true;
+    }
+};
+
+// A run stored in a file, the file handle and buffer only exist while the run is merged
+struct FileRun : Run {
+    std::filesystem::path path;
+    Comparator const* comparator;
+    std::vector<char> buffer;
+    std::ifstream input;
+    std::optional<Row> row;
+
+    FileRun(std::filesystem::path path_, Comparator const& comparator_)
+        : path{std::move(path_)}
+        , comparator{&comparator_}
+    {}
+    ~FileRun() override {
+        input.close();
+        auto ec = std::error_code{};
+        std::filesystem::remove(path, ec);
+    }
+
+    void open() override {
+        buffer.resize(RunBufferSize);
+        input.rdbuf()->pubsetbuf(buffer.data(), buffer.size());
+        input.open(path, std::ios::binary);
+        if (!input) {
+            throw std::runtime_error{fmt::format("failed opening temporary file {}", path)};
+        }
+        next();
+    }
+
+    auto head() const -> Row const* override {
+        return row ? &*row : nullptr;
+    }
+
+    void next() override {
+        auto readInt = [&]() {
+            uint64_t v{};
+            input.read(reinterpret_cast<char*>(&v), sizeof(v));
+            return v;
+        };
+        auto count = readInt();
+        if (!input) {
+            // exhausted, release the file handle and the buffer
+            row.reset();
+            input.close();
+            buffer = {};
+            return;
+        }
+        if (!row) row.emplace();
+        row->entries.resize(count);
+        for (auto& e : row->entries) {
+            e.resize(readInt());
+            input.read(e.data(), e.size());
+        }
+        if (!input) {
+            throw std::runtime_error{fmt::format("failed reading temporary file {}", path)};
+        }
+        comparator->prepare(*row);
+    }
+};
+
+// Number of runs that may be merged at once, each file run needs a file handle
+auto maxOpenFiles() -> size_t {
+    auto limit = ::sysconf(_SC_OPEN_MAX);
+    return limit > 0 ? std::max(size_t{2}, static_cast<size_t>(limit) / 2) : 256;
+}
+
+// Tournament tree over k runs, each internal node stores the loser of its match
+struct LoserTree {
+    std::vector<std::unique_ptr<Run>>& runs;
+    Comparator const& comparator;
+    std::vector<size_t> tree; // tree[0] is the overall winner
+
+    LoserTree(std::vector<std::unique_ptr<Run>>& runs_, Comparator const& comparator_)
+        : runs{runs_}
+        , comparator{comparator_}
+        , tree(runs.size(), 0)
+    {
+        for (auto& run : runs) {
+            run->open();
+        }
+        if (runs.size()) {
+            tree[0] = build(1);
+        }
+    }
+
+    // exhausted runs lose, ties are resolved by the run index to keep the sort stable
+    bool less(size_t a, size_t b) const {
+        auto ra = runs[a]->head();
+        auto rb = runs[b]->head();
+        if (!ra) return false;
+        if (!rb) return true;
+        auto c = comparator.compare(*ra, *rb);
+        return c < 0 || (c == 0 && a < b);
+    }
+
+    // returns the winner of the subtree
+    auto build(size_t node) -> size_t {
+        if (node >= runs.size()) return node - runs.size();
+        auto w1 = build(node*2);
+        auto w2 = build(node*2+1);
+        if (less(w1, w2)) {
+            tree[node] = w2;
+            return w1;
+        }
+        tree[node] = w1;
+        return w2;
+    }
+
+    auto top() const -> Row const* {
+        return runs.empty() ? nullptr : runs[tree[0]]->head();
+    }
+
+    // advances the winning run and replays its path to the root
+    void pop() {
+        auto winner = tree[0];
+        runs[winner]->next();
+        for (auto node = (winner + runs.size()) / 2; node > 0; node /= 2) {
+            if (less(tree[node], winner)) {
+                std::swap(tree[node], winner);
+            }
+        }
+        tree[0] = winner;
+    }
+};
+
+void app() {
+    if (cliCmd->size() == 0) {
+        fmt::print("No files given\n");
+        return;
+    }
+
+    auto comparator = Comparator{};
+    for (auto const& k : *cliKeys) {
+        comparator.keys.push_back(parseKey(k));
+    }
+    auto jobs = *cliJobs > 0 ? *cliJobs : std::max(size_t{1}, size_t{std::thread::hardware_concurrency()});
+    auto maxMemory   = *cliMaxMemory * 1024 * 1024;
+    auto chunkBudget = std::max(size_t{1}, maxMemory / (2 * (jobs + 1)));
+    auto tmpDir      = TempDirectory{cliTmpDir ? *cliTmpDir : std::filesystem::temp_directory_path()};
+
+    // runs are sorted in parallel, they stay in memory as long as half of the budget is not exceeded
+    auto residentMemory = std::atomic_size_t{0};
+    auto pending        = std::deque<std::future<std::unique_ptr<Run>>>{};
+    auto runs           = std::vector<std::unique_ptr<Run>>{};
+    size_t runCount{0};
+    auto submit = [&](std::vector<Row> chunk, size_t chunkMemory) {
+        if (pending.size() >= jobs) {
+            runs.push_back(pending.front().get());
+            pending.pop_front();
+        }
+        auto path = tmpDir.path / fmt::format("{}.run", runCount++);
+        pending.push_back(std::async(std::launch::async, [&, path, chunkMemory, chunk = std::move(chunk)]() mutable -> std::unique_ptr<Run> {
+            std::ranges::stable_sort(chunk, comparator);
+            if (residentMemory += chunkMemory; residentMemory <= maxMemory / 2) {
+                return std::make_unique<MemoryRun>(std::move(chunk));
+            }
+            residentMemory -= chunkMemory;
+            auto output = RunWriter{path};
+            for (auto const& row : chunk) {
+                output.write(row);
+            }
+            output.finish();
+            chunk = {};
+            return std::make_unique<FileRun>(path, comparator);
+        }));
+    };
+
+    auto header = std::optional<Row>{};
+    auto chunk  = std::vector<Row>{};
+    size_t chunkMemory{0};
+    for (auto const& p : *cliCmd) {
+        auto reader = ivio::csv::reader{{.input = p,
+                                         .delimiter = *cliDelimiter,
+                                         .trim      = !cliNoTrim,
+        }};
+        bool firstLine = true;
+        for (auto record : reader) {
+            auto row = Row{};
+            for (auto const& e : record.entries) {
+                row.entries.emplace_back(e);
+            }
+            if (firstLine && cliHeader) {
+                firstLine = false;
+                if (!header) header = std::move(row);
+                continue;
+            }
+            firstLine = false;
+            comparator.prepare(row);
+            chunkMemory += row.memoryUsage();
+            chunk.emplace_back(std::move(row));
+            if (chunkMemory >= chunkBudget) {
+                submit(std::move(chunk), chunkMemory);
+                chunk       = {};
+                chunkMemory = 0;
+            }
+        }
+    }
+    if (chunk.size()) {
+        submit(std::move(chunk), chunkMemory);
+    }
+    for (auto& f : pending) {
+        runs.push_back(f.get());
+    }
+    pending.clear();
+
+    // The read buffers of merged file runs share the half of the budget not used by runs kept
+    // in memory (one buffer is reserved for the output of intermediate merges).
+    // If there are more runs, consecutive runs are merged first, which keeps the sort stable.
+    auto readBuffers = maxMemory / 2 / RunBufferSize;
+    auto fanIn = std::clamp(readBuffers > 0 ? readBuffers - 1 : 0, size_t{2}, maxOpenFiles());
+    while (runs.size() > fanIn) {
+        auto merged = std::vector<std::unique_ptr<Run>>{};
+        for (size_t i{0}; i < runs.size(); i += fanIn) {
+            auto group = std::vector<std::unique_ptr<Run>>{};
+            for (size_t j{i}; j < std::min(i + fanIn, runs.size()); ++j) {
+                group.push_back(std::move(runs[j]));
+            }
+            if (group.size() == 1) {
+                merged.push_back(std::move(group[0]));
+                continue;
+            }
+            auto path = tmpDir.path / fmt::format("{}.run", runCount++);
+            auto output = RunWriter{path};
+            auto tree = LoserTree{group, comparator};
+            for (auto row = tree.top(); row; tree.pop(), row = tree.top()) {
+                output.write(*row);
+            }
+            output.finish();
+            merged.push_back(std::make_unique<FileRun>(path, comparator));
+        }
+        runs = std::move(merged);
+    }
+
+    // k-way merge of all runs
+    auto writer = ivio::table::csv_writer{{.output    = std::cout,
+                                           .delimiter = *cliDelimiter,
+    }};
+    if (header) {
+        writer.write({
+            .entries = header->entries,
+        });
+    }
+    auto tree = LoserTree{runs, comparator};
+    for (auto row = tree.top(); row; tree.pop(), row = tree.top()) {
+        writer.write({
+            .entries = row->entries,
+        });
+    }
+}
+}
@@ -0,0 +1,40 @@
+// SPDX-FileCopyrightText: 2023 Gottlieb+Freitag <info@gottliebtfreitag.de>
+// SPDX-License-Identifier: CC0-1.0
+#include "table.h"
+
+#include <ivio/csv/reader.h>
+#include <string_view>
+
+namespace csvtools {
+
+namespace {
+auto read(ivio::csv::reader& reader, std::pmr::memory_resource* resource) -> Table {
+    auto table = Table{resource};
+    for (auto record : reader) {
+        auto& entries = table.emplace_back();
+        entries.reserve(record.entries.size());
+        for (auto const& e : record.entries) {
+            entries.emplace_back(std::string_view{e});
+        }
+    }
+    return table;
+}
+}
+
+auto readTable(std::filesystem::path const& path, char delimiter, bool trim, std::pmr::memory_resource* resource) -> Table {
+    auto reader = ivio::csv::reader{{.input = path,
+                                     .delimiter = delimiter,
+                                     .trim      = trim,
+    }};
+    return read(reader, resource);
+}
+
+auto readTable(std::istream& input, char delimiter, bool trim, std::pmr::memory_resource* resource) -> Table {
+    auto reader = ivio::csv::reader{{.input = input,
+                                     .delimiter = delimiter,
+                                     .trim      = trim,
+    }};
+    return read(reader, resource);
+}
+
+}
@@ -0,0 +1,21 @@
+// SPDX-FileCopyrightText: 2023 Gottlieb+Freitag <info@gottliebtfreitag.de>
+// SPDX-License-Identifier: CC0-1.0
+#pragma once
+
+#include <filesystem>
+#include <istream>
+#include <memory_resource>
+#include <string>
+#include <vector>
+
+namespace csvtools {
+
+// In memory table, all rows and entries are allocated from the memory resource of the table
+using Row   = std::pmr::vector<std::pmr::string>;
+using Table = std::pmr::vector<Row>;
+
+// Reads a csv file or stream into memory allocated from the given resource
+auto readTable(std::filesystem::path const& path, char delimiter = ',', bool trim = true, std::pmr::memory_resource* resource = std::pmr::get_default_resource()) -> Table;
+auto readTable(std::istream& input, char delimiter = ',', bool trim = true, std::pmr::memory_resource* resource = std::pmr::get_default_resource()) -> Table;
+
+}
@@ -0,0 +1,58 @@
+// SPDX-FileCopyrightText: 2006-2023, Knut Reinert & Freie Universität Berlin
+// SPDX-FileCopyrightText: 2016-2023, Knut Reinert & MPI für molekulare Genetik
+// SPDX-License-Identifier: BSD-3-Clause
+#include "csv_writer.h"
+#include "emitter.h"
+
+#include <cassert>
+
+namespace ivio {
+
+// All rendering is done by the emitter, only the delimiter is chosen at runtime
+template <>
+struct writer_base<table::csv_writer>::pimpl {
+    table::emitter<table::format::csv> emitter;
+
+    pimpl(table::csv_writer::config config)
+        : emitter {{
+            .output = std::move(config.output),
+            .format = {
+                .entrySeparator = config.delimiter,
+            },
+        }}
+    {}
+};
+
+}
+
+namespace ivio::table {
+
+csv_writer::csv_writer(config config_)
+    : writer_base{std::make_unique<pimpl>(std::move(config_))}
+{
+}
+
+csv_writer::~csv_writer() {
+    close();
+}
+
+void csv_writer::write(record_view record) {
+    assert(pimpl_);
+    pimpl_->emitter.write(record);
+}
+
+void csv_writer::flush() {
+    assert(pimpl_);
+    pimpl_->emitter.flush();
+}
+
+void csv_writer::close() {
+    if (pimpl_) {
+        pimpl_->emitter.close();
+    }
+    pimpl_.reset();
+}
+
+static_assert(record_writer_c<csv_writer>);
+
+}
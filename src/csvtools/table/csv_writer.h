@@ -0,0 +1,45 @@
+// SPDX-FileCopyrightText: 2006-2023, Knut Reinert & Freie Universität Berlin
+// SPDX-FileCopyrightText: 2016-2023, Knut Reinert & MPI für molekulare Genetik
+// SPDX-License-Identifier: BSD-3-Clause
+#pragma once
+
+#include "ivio/detail/concepts.h"
+#include "ivio/detail/writer_base.h"
+
+#include "record.h"
+
+#include <filesystem>
+#include <functional>
+#include <ostream>
+#include <variant>
+
+namespace ivio::table {
+
+// Streaming RFC 4180 writer, entries are not padded and quoted if required
+struct csv_writer : writer_base<csv_writer> {
+    using record_view = table::record_view; //!doc: see record_writer_c<writer> concept
+
+    struct config {
+        // Source: file or stream
+        std::variant<std::filesystem::path, std::reference_wrapper<std::ostream>> output;
+
+        // How each entry should be separated
+        char delimiter {','};
+    };
+
+    csv_writer(config config);
+    ~csv_writer();
+
+    //!doc: see record_writer_c<writer> concept
+    void write(record_view record);
+
+    // Writes all buffered records
+    void flush();
+
+    //!doc: see record_writer_c<writer> concept
+    void close();
+};
+
+static_assert(record_writer_c<csv_writer>);
+
+}
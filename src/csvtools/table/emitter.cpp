@@ -0,0 +1,77 @@
+// SPDX-FileCopyrightText: 2006-2023, Knut Reinert & Freie Universität Berlin
+// SPDX-FileCopyrightText: 2016-2023, Knut Reinert & MPI für molekulare Genetik
+// SPDX-License-Identifier: BSD-3-Clause
+#include "emitter.h"
+
+#include <string_view>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace ivio::table {
+
+namespace {
+
+bool isSpecial(char c, char delimiter) {
+    return c == delimiter || c == '"' || c == '\n' || c == '\r';
+}
+
+// Checks if an entry must be quoted: it contains the delimiter, a quote or a line break.
+// Leading or trailing white spaces are quoted as well, they would be trimmed by the reader
+bool needsQuoting(std::string_view s, char delimiter) {
+    if (s.empty()) return false;
+    if (s.front() == ' ' || s.back() == ' ' || s.front() == '\t' || s.back() == '\t') return true;
+
+    size_t i{0};
+#if defined(__SSE2__)
+    auto const d  = _mm_set1_epi8(delimiter);
+    auto const q  = _mm_set1_epi8('"');
+    auto const nl = _mm_set1_epi8('\n');
+    auto const cr = _mm_set1_epi8('\r');
+    for (; i + 16 <= s.size(); i += 16) {
+        auto v = _mm_loadu_si128(reinterpret_cast<__m128i const*>(s.data() + i));
+        auto m = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, d),  _mm_cmpeq_epi8(v, q)),
+                              _mm_or_si128(_mm_cmpeq_epi8(v, nl), _mm_cmpeq_epi8(v, cr)));
+        if (_mm_movemask_epi8(m)) return true;
+    }
+#endif
+    for (; i < s.size(); ++i) {
+        if (isSpecial(s[i], delimiter)) return true;
+    }
+    return false;
+}
+
+}
+
+namespace detail {
+
+void appendCsvEntry(std::string& buffer, std::string_view s, char delimiter) {
+    if (!needsQuoting(s, delimiter)) {
+        buffer += s;
+        return;
+    }
+    buffer += '"';
+    for (auto pos = s.find('"'); pos != std::string_view::npos; pos = s.find('"')) {
+        buffer += s.substr(0, pos + 1);
+        buffer += '"';
+        s = s.substr(pos + 1);
+    }
+    buffer += s;
+    buffer += '"';
+}
+
+void appendTsvEntry(std::string& buffer, std::string_view s) {
+    for (auto c : s) {
+        switch (c) {
+        case '\t':  buffer += "\\t";  break;
+        case '\n':  buffer += "\\n";  break;
+        case '\r':  buffer += "\\r";  break;
+        case '\\': buffer += "\\\\"; break;
+        default:    buffer += c;
+        }
+    }
+}
+
+}
+}
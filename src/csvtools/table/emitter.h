@@ -0,0 +1,417 @@
+// SPDX-FileCopyrightText: 2006-2023, Knut Reinert & Freie Universität Berlin
+// SPDX-FileCopyrightText: 2016-2023, Knut Reinert & MPI für molekulare Genetik
+// SPDX-License-Identifier: BSD-3-Clause
+#pragma once
+
+#include "ivio/detail/file_writer.h"
+#include "ivio/detail/stream_writer.h"
+
+#include "record.h"
+
+#include <algorithm>
+#include <cassert>
+#include <concepts>
+#include <filesystem>
+#include <fmt/format.h>
+#include <functional>
+#include <iterator>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <variant>
+#include <vector>
+
+namespace ivio::table {
+
+namespace detail {
+// Appends an entry of a csv line, quoted if required (RFC 4180)
+void appendCsvEntry(std::string& buffer, std::string_view entry, char delimiter);
+
+// Appends an entry of a tsv line, tabs, line breaks and backslashes are escaped
+void appendTsvEntry(std::string& buffer, std::string_view entry);
+
+// Number of code points of an utf8 string
+inline auto displayWidth(std::string_view s) -> size_t {
+    return std::ranges::count_if(s, [](char c) {
+        return (static_cast<unsigned char>(c) & 0xC0) != 0x80;
+    });
+}
+}
+
+// Format policies of the emitter
+//   padded:          columns are aligned, records are buffered until flush()/close()
+//   headerSeparator: if the first line is a header, it is followed by a separator line
+//   alwaysHeader:    the first line is always a header
+//   altSuffix:       specific rows may end with a different suffix
+//   minWidth:        minimal width of a padded column
+namespace format {
+
+struct table {
+    static constexpr bool padded          = true;
+    static constexpr bool headerSeparator = true;
+    static constexpr bool alwaysHeader    = false;
+    static constexpr bool altSuffix       = false;
+    static constexpr size_t minWidth      = 0;
+    static constexpr std::string_view linePrefix     = "| ";
+    static constexpr std::string_view lineSuffix     = " |";
+    static constexpr std::string_view entrySeparator = " | ";
+
+    static void escape(std::string& buffer, std::string_view entry) {
+        buffer += entry;
+    }
+};
+
+// GitHub flavored markdown table
+struct markdown {
+    static constexpr bool padded          = true;
+    static constexpr bool headerSeparator = true;
+    static constexpr bool alwaysHeader    = true;
+    static constexpr bool altSuffix       = false;
+    static constexpr size_t minWidth      = 3;
+    static constexpr std::string_view linePrefix     = "| ";
+    static constexpr std::string_view lineSuffix     = " |";
+    static constexpr std::string_view entrySeparator = " | ";
+
+    static void escape(std::string& buffer, std::string_view entry) {
+        for (auto c : entry) {
+            if (c == '|') buffer += '\\';
+            buffer += (c == '\n' || c == '\r') ? ' ' : c;
+        }
+    }
+};
+
+// Body of a LaTeX tabular, entries are not escaped so they can contain LaTeX commands
+struct latex {
+    static constexpr bool padded          = true;
+    static constexpr bool headerSeparator = false;
+    static constexpr bool alwaysHeader    = false;
+    static constexpr bool altSuffix       = true;
+    static constexpr size_t minWidth      = 0;
+    static constexpr std::string_view linePrefix     = "";
+    static constexpr std::string_view lineSuffix     = "\\\\";
+    static constexpr std::string_view entrySeparator = " & ";
+
+    static void escape(std::string& buffer, std::string_view entry) {
+        buffer += entry;
+    }
+};
+
+// RFC 4180, entries are quoted if required. The delimiter is chosen at runtime, see csv_writer
+struct csv {
+    static constexpr bool padded          = false;
+    static constexpr bool headerSeparator = false;
+    static constexpr bool alwaysHeader    = false;
+    static constexpr bool altSuffix       = false;
+    static constexpr size_t minWidth      = 0;
+    static constexpr std::string_view linePrefix = "";
+    static constexpr std::string_view lineSuffix = "";
+    char entrySeparator {','};
+
+    void escape(std::string& buffer, std::string_view entry) const {
+        detail::appendCsvEntry(buffer, entry, entrySeparator);
+    }
+};
+
+struct tsv {
+    static constexpr bool padded          = false;
+    static constexpr bool headerSeparator = false;
+    static constexpr bool alwaysHeader    = false;
+    static constexpr bool altSuffix       = false;
+    static constexpr size_t minWidth      = 0;
+    static constexpr std::string_view linePrefix     = "";
+    static constexpr std::string_view lineSuffix     = "";
+    static constexpr std::string_view entrySeparator = "\t";
+
+    static void escape(std::string& buffer, std::string_view entry) {
+        detail::appendTsvEntry(buffer, entry);
+    }
+};
+
+// Aligned table with separators chosen at runtime, see table::writer
+struct dynamic {
+    static constexpr bool padded          = true;
+    static constexpr bool headerSeparator = true;
+    static constexpr bool alwaysHeader    = false;
+    static constexpr bool altSuffix       = true;
+    static constexpr size_t minWidth      = 0;
+    std::string linePrefix {"| "};
+    std::string lineSuffix {" |"};
+    std::string entrySeparator {" | "};
+
+    static void escape(std::string& buffer, std::string_view entry) {
+        buffer += entry;
+    }
+};
+
+}
+
+// Writes records in the layout given by the format policy, all decisions
+// about the layout are made at compile time
+template <typename Format>
+class emitter {
+public:
+    struct config {
+        // Source: file or stream
+        std::variant<std::filesystem::path, std::reference_wrapper<std::ostream>> output;
+
+        // If the first entry is a header line
+        bool firstLineHeader {false};
+
+        // alternative suffix for specific rows, only used if the format supports it
+        std::unordered_map<size_t, std::string> lineAltSuffix;
+
+        // runtime parameters of the format, empty for most formats
+        Format format {};
+
+        // Height of the terminal the output is shown on (0: not a terminal), see update() and flush()
+        size_t terminalLines {0};
+    };
+
+    explicit emitter(config config_)
+        : writer {std::visit([](auto& o) -> Writers {
+            if constexpr (std::same_as<std::decay_t<decltype(o)>, std::filesystem::path>) {
+                return file_writer{o};
+            } else {
+                return stream_writer{o.get()};
+            }
+        }, config_.output)}
+        , format {std::move(config_.format)}
+        , header {Format::headerSeparator && (config_.firstLineHeader || Format::alwaysHeader)}
+        , terminalLines {config_.terminalLines}
+    {
+        if constexpr (Format::altSuffix) {
+            // sorted by descending row, the suffix of the next written record is at the back
+            pendingAltSuffix.assign(std::make_move_iterator(config_.lineAltSuffix.begin()),
+                                    std::make_move_iterator(config_.lineAltSuffix.end()));
+            std::ranges::sort(pendingAltSuffix, std::ranges::greater{}, [](auto const& p) { return p.first; });
+        }
+    }
+
+    emitter(emitter const&) = delete;
+    emitter(emitter&&) = delete;
+    ~emitter() {
+        close();
+    }
+
+    void write(record_view record) {
+        assert(writer);
+        // resolve the type of the entries once per record, not once per entry
+        std::visit([&](auto const& entries) {
+            writeEntries(entries);
+        }, record.entries);
+    }
+
+    // Replaces an already written record. If it was already printed and is still visible
+    // on the terminal, it is redrawn on the next flush
+    void update(size_t row, record_view record) requires Format::padded {
+        assert(writer);
+        assert(row < records.size());
+        std::visit([&](auto const& entries) {
+            escapeEntries(entries, records[row].entries);
+        }, record.entries);
+        updateWidth(row);
+        if (terminalLines > 0 && row < flushedRecords) {
+            dirtyRecords.push_back(row);
+        }
+    }
+
+    // Prints all records written so far. For padded formats on a terminal, updated records are
+    // redrawn in place (ANSI escape codes) and growing columns are widened with some slack, only
+    // lines still visible on the terminal are redrawn. Otherwise records are only appended and
+    // the width of columns is fixed by the first flush.
+    void flush() {
+        assert(writer);
+        if constexpr (Format::padded) {
+            // the header is followed by its separator line, even if it is the only record
+            auto printedLines = flushedRecords + ((header && flushedRecords > 0) ? 1 : 0);
+            if (flushedRecords == 0) {
+                width = longestEntry;
+            } else if (terminalLines > 0 && !fitsWidth()) {
+                width.resize(longestEntry.size(), 0);
+                for (size_t j{0}; j < width.size(); ++j) {
+                    if (longestEntry[j] > width[j]) {
+                        width[j] = longestEntry[j] + longestEntry[j] / 4;
+                    }
+                }
+                // move to the first visible line and redraw everything below
+                auto visible = std::min(printedLines, terminalLines - 1);
+                if (visible > 0) {
+                    buffer += fmt::format("\x1b[{}A\r\x1b[J", visible);
+                }
+                for (auto line{printedLines - visible}; line < printedLines; ++line) {
+                    renderLine(line);
+                    buffer += '\n';
+                }
+                dirtyRecords.clear();
+            } else {
+                // printed records keep their widths, only new columns are added
+                for (size_t j{width.size()}; j < longestEntry.size(); ++j) {
+                    width.push_back(longestEntry[j]);
+                }
+            }
+
+            // redraw updated records, if they are visible
+            for (auto row : dirtyRecords) {
+                auto up = printedLines - lineOf(row);
+                if (up >= terminalLines) continue;
+                buffer += fmt::format("\x1b[{}A\r", up);
+                renderRecord(row);
+                buffer += fmt::format("\x1b[K\r\x1b[{}B", up);
+            }
+            dirtyRecords.clear();
+
+            // print new records
+            for (size_t i{flushedRecords}; i < records.size(); ++i) {
+                renderRecord(i);
+                buffer += '\n';
+                if (i == 0 && header) {
+                    renderHeaderSeparator();
+                    buffer += '\n';
+                }
+            }
+            flushedRecords = records.size();
+        }
+        flushBuffer();
+    }
+
+    void close() {
+        if (writer) {
+            flush();
+        }
+        writer.reset();
+    }
+
+private:
+    using Writers = std::variant<file_writer, stream_writer>;
+
+    static constexpr size_t FlushSize = 1<<20;
+
+    std::optional<Writers> writer;
+    [[no_unique_address]] Format format;
+    bool header;
+    size_t terminalLines;
+    std::vector<std::optional<std::string>> altSuffix; // indexed by row, grows with the written records
+    std::vector<std::pair<size_t, std::string>> pendingAltSuffix; // suffixes of rows not written yet
+    std::string buffer;
+
+    // only used by padded formats
+    std::vector<record> records;      // escaped entries
+    std::vector<size_t> longestEntry;
+    std::vector<size_t> width;        // column widths used for printing, at least longestEntry after a flush
+    size_t flushedRecords{0};         // number of records already printed
+    std::vector<size_t> dirtyRecords; // printed records that have been updated
+
+    template <typename Entries>
+    void writeEntries(Entries const& entries) {
+        if constexpr (Format::padded) {
+            escapeEntries(entries, records.emplace_back().entries);
+            updateWidth(records.size()-1);
+            if constexpr (Format::altSuffix) {
+                auto& suffix = altSuffix.emplace_back();
+                if (!pendingAltSuffix.empty() && pendingAltSuffix.back().first == records.size()-1) {
+                    suffix = std::move(pendingAltSuffix.back().second);
+                    pendingAltSuffix.pop_back();
+                }
+            }
+        } else {
+            buffer += format.linePrefix;
+            if (entries.size() > 0) {
+                format.escape(buffer, entries[0]);
+            }
+            for (size_t j{1}; j < entries.size(); ++j) {
+                buffer += format.entrySeparator;
+                format.escape(buffer, entries[j]);
+            }
+            buffer += format.lineSuffix;
+            buffer += '\n';
+            if (buffer.size() >= FlushSize) {
+                flushBuffer();
+            }
+        }
+    }
+
+    template <typename Entries>
+    void escapeEntries(Entries const& source, std::vector<std::string>& entries) {
+        entries.clear();
+        entries.resize(source.size());
+        for (size_t j{0}; j < entries.size(); ++j) {
+            format.escape(entries[j], source[j]);
+        }
+    }
+
+    void flushBuffer() {
+        std::visit([&](auto& w) {
+            w.write(buffer);
+        }, *writer);
+        buffer.clear();
+    }
+
+    // line on which a record is printed, the header is followed by a separator line
+    auto lineOf(size_t row) const -> size_t {
+        return row + ((header && row > 0) ? 1 : 0);
+    }
+
+    bool fitsWidth() const {
+        if (longestEntry.size() > width.size()) return false;
+        for (size_t j{0}; j < longestEntry.size(); ++j) {
+            if (longestEntry[j] > width[j]) return false;
+        }
+        return true;
+    }
+
+    void updateWidth(size_t row) {
+        auto const& entries = records[row].entries;
+        longestEntry.resize(std::max(longestEntry.size(), entries.size()), Format::minWidth);
+        for (size_t j{0}; j < entries.size(); ++j) {
+            longestEntry[j] = std::max(longestEntry[j], detail::displayWidth(entries[j]));
+        }
+    }
+
+    void renderEntry(std::string const& entry, size_t j) {
+        auto w = detail::displayWidth(entry);
+        buffer.append(std::max(width[j], w) - w, ' ');
+        buffer += entry;
+    }
+
+    void renderLine(size_t line) {
+        if (header && line == 1) {
+            renderHeaderSeparator();
+        } else {
+            renderRecord((header && line > 1) ? line - 1 : line);
+        }
+    }
+
+    void renderRecord(size_t row) {
+        auto const& entries = records[row].entries;
+        buffer += format.linePrefix;
+        if (entries.size() > 0) {
+            renderEntry(entries[0], 0);
+        }
+        for (size_t j{1}; j < entries.size(); ++j) {
+            buffer += format.entrySeparator;
+            renderEntry(entries[j], j);
+        }
+        if constexpr (Format::altSuffix) {
+            if (altSuffix[row]) {
+                buffer += *altSuffix[row];
+                return;
+            }
+        }
+        buffer += format.lineSuffix;
+    }
+
+    void renderHeaderSeparator() {
+        auto const& entries = records[0].entries;
+        buffer += format.linePrefix;
+        for (size_t j{0}; j < entries.size(); ++j) {
+            if (j > 0) buffer += format.entrySeparator;
+            buffer.append(width[j], '-');
+        }
+        buffer += format.lineSuffix;
+    }
+};
+
+}
@@ -6,7 +6,11 @@
 #include "ivio/detail/compare.h"
 //#include "../detail/compare.h"
 
+#include <memory_resource>
+#include <span>
 #include <string>
+#include <string_view>
+#include <variant>
 #include <vector>
 
 namespace ivio::table {
@@ -14,7 +18,16 @@ namespace ivio::table {
 struct record;
 
 struct record_view {
-    std::span<std::string const> entries;
+    // entries of a std::vector<std::string> or a std::pmr::vector<std::pmr::string>
+    std::variant<std::span<std::string const>, std::span<std::pmr::string const>> entries;
+
+    auto size() const -> size_t {
+        return std::visit([](auto const& e) { return e.size(); }, entries);
+    }
+    auto operator[](size_t i) const -> std::string_view {
+        return std::visit([&](auto const& e) { return std::string_view{e[i]}; }, entries);
+    }
+
     operator record() const;
     auto operator<=>(record_view const&) const = default;
 };
@@ -29,9 +42,14 @@ struct record {
 
 // Implementation of the convert operators
 inline record_view::operator record() const {
-    return {
-        .entries = std::vector<std::string>(begin(entries), end(entries)),
-    };
+    return std::visit([](auto const& e) {
+        auto r = record{};
+        r.entries.reserve(e.size());
+        for (auto const& v : e) {
+            r.entries.emplace_back(v);
+        }
+        return r;
+    }, entries);
 }
 inline record::operator record_view() const {
     return {
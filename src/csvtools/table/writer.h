@@ -39,6 +39,9 @@ struct writer : writer_base<writer> {
 
         // If the first entry is a header line
         bool firstLineHeader {false};
+
+        // Height of the terminal the output is shown on (0: not a terminal), see flush()
+        size_t terminalLines {0};
     };
 
     writer(config config);
@@ -47,6 +50,13 @@ struct writer : writer_base<writer> {
     //!doc: see record_writer_c<writer> concept
     void write(record_view record);
 
+    // Replaces an already written record
+    void update(size_t row, record_view record);
+
+    // Prints all records written so far. On a terminal, updated records are redrawn in place
+    // (ANSI escape codes) as long as they are visible, otherwise records are only appended.
+    void flush();
+
     //!doc: see record_writer_c<writer> concept
     void close();
 };
@@ -0,0 +1,88 @@
+// SPDX-FileCopyrightText: 2023 Gottlieb+Freitag <info@gottliebtfreitag.de>
+// SPDX-License-Identifier: CC0-1.0
+#include "table_cache.h"
+
+#include <list>
+#include <map>
+#include <mutex>
+
+namespace csvtools {
+
+namespace {
+struct TableCacheKey {
+    std::filesystem::path path;
+    char delimiter;
+    bool trim;
+
+    auto operator<=>(TableCacheKey const&) const = default;
+};
+
+struct Entry {
+    std::filesystem::file_time_type mtime;
+    uintmax_t size;
+    std::shared_ptr<Table const> table;
+    std::list<TableCacheKey>::iterator lruPos;
+};
+
+struct Cache {
+    std::mutex mutex;
+    size_t capacity{0};
+    std::map<TableCacheKey, Entry> entries;
+    std::list<TableCacheKey> lru; // most recently used first
+};
+
+auto cache() -> Cache& {
+    static auto c = Cache{};
+    return c;
+}
+}
+
+auto loadTable(std::filesystem::path const& path, char delimiter, bool trim) -> std::shared_ptr<Table const> {
+    auto& c = cache();
+    auto key = TableCacheKey{std::filesystem::absolute(path), delimiter, trim};
+
+    auto ec    = std::error_code{};
+    auto mtime = std::filesystem::last_write_time(path, ec);
+    auto size  = std::filesystem::file_size(path, ec);
+    bool cacheable = !ec;
+
+    {
+        auto g = std::lock_guard{c.mutex};
+        if (cacheable && c.capacity > 0) {
+            if (auto iter = c.entries.find(key); iter != c.entries.end()) {
+                auto& entry = iter->second;
+                if (entry.mtime == mtime && entry.size == size) {
+                    c.lru.splice(c.lru.begin(), c.lru, entry.lruPos);
+                    return entry.table;
+                }
+                c.lru.erase(entry.lruPos);
+                c.entries.erase(iter);
+            }
+        }
+    }
+
+    auto table = std::make_shared<Table const>(readTable(path, delimiter, trim));
+
+    auto g = std::lock_guard{c.mutex};
+    if (cacheable && c.capacity > 0 && !c.entries.contains(key)) {
+        c.lru.push_front(key);
+        c.entries.try_emplace(key, Entry{mtime, size, table, c.lru.begin()});
+        while (c.entries.size() > c.capacity) {
+            c.entries.erase(c.lru.back());
+            c.lru.pop_back();
+        }
+    }
+    return table;
+}
+
+void setTableCacheCapacity(size_t capacity) {
+    auto& c = cache();
+    auto g = std::lock_guard{c.mutex};
+    c.capacity = capacity;
+    while (c.entries.size() > c.capacity) {
+        c.entries.erase(c.lru.back());
+        c.lru.pop_back();
+    }
+}
+
+}
@@ -0,0 +1,19 @@
+// SPDX-FileCopyrightText: 2023 Gottlieb+Freitag <info@gottliebtfreitag.de>
+// SPDX-License-Identifier: CC0-1.0
+#pragma once
+
+#include "table.h"
+
+#include <filesystem>
+#include <memory>
+
+namespace csvtools {
+
+// Loads a csv file. If the cache is enabled, parsed files are kept and
+// reused until the modification time or size of the file changes. Can be called from any thread.
+auto loadTable(std::filesystem::path const& path, char delimiter, bool trim) -> std::shared_ptr<Table const>;
+
+// Number of tables kept in the cache, least recently used tables are dropped first (0: disabled)
+void setTableCacheCapacity(size_t capacity);
+
+}